@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,7 +12,39 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
-
+//
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each with its own spin-lock, so that lookups of different
+// blocks on different harts do not contend.  A bucket's lock
+// protects the bucket's list and the refcnt, lastuse, dev and
+// blockno fields of the buffers on it.  No code path holds two
+// bucket locks at once.
+//
+// Eviction is LRU by timestamp: brelse() stamps a buffer with
+// a global use counter when its last reference goes away, and
+// a miss recycles the unused buffer with the oldest stamp.
+//
+// The first NBUF buffers have static data.  Beyond that the
+// cache grows on misses, up to NBUFMAX buffers, by backing
+// BPP buffer headers at a time with a page from kalloc().
+// When kalloc() runs out of memory it calls bshrink() to take
+// back pages whose buffers are all unused, or only pinned by
+// the log; those it first moves to spare buffers elsewhere.
+//
+// I/O can also be started without waiting for it:
+// * bsubmit() starts reading or writing a locked buffer.
+//     Call bwait() before using or releasing the buffer, or
+//     pass a completion function for the disk interrupt
+//     handler to call instead.
+// * bsubmitv() does the same for several buffers.  The disk's
+//     elevator sorts all queued buffers by block, and hands
+//     those for consecutive blocks to the disk as one request.
+// * bread_async() is bread() with the read left to bwait().
+// * bread_asyncv() is bread_async() for a run of blocks.
+// * breadahead() starts reading a block into the cache.
+//     The buffer stays locked, with a reference, until the
+//     disk interrupt handler calls breaddone(), so a bread()
+//     of the block in the meantime waits for the read.
 
 #include "types.h"
 #include "param.h"
@@ -23,69 +55,532 @@
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#define NBUCKET 13
+#define BHASH(dev, blockno) ((((dev) << 27) | (blockno)) % NBUCKET)
+
+// A buffer that holds no block is parked as (NODEV, its index),
+// so that every buffer on a bucket is on BHASH(dev, blockno).
+#define NODEV ((uint)-1)
+
+#define BPP (PGSIZE / BSIZE)                // buffers per kalloc'd page
+#define NBUFPAGE ((NBUFMAX - NBUF) / BPP)   // pages the cache may grow by
+#define NSHRINK 8                           // pages bshrink() frees at most
+#define NBATCH 64                           // blocks bread_asyncv() takes at most
+
+// What bget() does about a block that is already cached.
+#define BWAIT  0   // wait for its buffer's lock
+#define BPROBE 1   // return 0, as when no buffer is free
+#define BTRY   2   // return 0 if another process holds its lock
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf head;  // circular list of buffers, through prev/next.
+};
+
+struct {
+  struct buf buf[NBUFMAX];
+  uchar data[NBUF][BSIZE];
+  struct bucket bucket[NBUCKET];
+  uint clock;       // source of lastuse timestamps.
+
+  // growlock protects page[] and npage.  page[i] backs
+  // buf[NBUF + i*BPP] through buf[NBUF + i*BPP + BPP-1].
+  struct spinlock growlock;
+  char *page[NBUFPAGE];
+  int npage;
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // statistics.
+  uint nhit;
+  uint nmiss;
+  uint nevict;
+  uint ngrow;
+  uint nshrink;
+  uint nmove;       // pinned buffers moved by bshrink()
+  uint nra;         // read-aheads started
+  uint nrahit;      // ... and later found by bread()
+  uint nread;       // blocks read from disk
+  uint nwrite;      // blocks written to disk
 } bcache;
 
+struct bdevsw bdevsw[NBDEV];
+
+// Register a disk under the next free device number, the
+// first at ROOTDEV, and return the number, or -1 if there
+// are no more.  Only called while booting.
+int
+bregister(struct bdevsw *sw)
+{
+  int dev;
+
+  for(dev = ROOTDEV; dev < NBDEV; dev++){
+    if(bdevsw[dev].start == 0){
+      bdevsw[dev] = *sw;
+      return dev;
+    }
+  }
+  return -1;
+}
+
+// The driver for device dev's disk.
+static struct bdevsw*
+bdev(uint dev)
+{
+  if(dev >= NBDEV || bdevsw[dev].start == 0)
+    panic("bdev: no disk");
+  return &bdevsw[dev];
+}
+
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+static void
+blink(struct bucket *bkt, struct buf *b)
+{
+  b->next = bkt->head.next;
+  b->prev = &bkt->head;
+  bkt->head.next->prev = b;
+  bkt->head.next = b;
+}
+
+// Put b, which holds no block, on its bucket as unused.
+// Caller must not hold any bucket lock.
+static void
+bpark(struct buf *b)
+{
+  struct bucket *bkt;
+
+  b->dev = NODEV;
+  b->blockno = b - bcache.buf;
+  b->refcnt = 0;
+  bkt = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bkt->lock);
+  blink(bkt, b);
+  release(&bkt->lock);
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bkt;
 
-  initlock(&bcache.lock, "bcache");
+  initlock(&bcache.growlock, "bcache.grow");
+  for(bkt = bcache.bucket; bkt < bcache.bucket+NBUCKET; bkt++){
+    initlock(&bkt->lock, "bcache.bucket");
+    bkt->head.prev = &bkt->head;
+    bkt->head.next = &bkt->head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // The static buffers start out belonging to no block.
+  // The rest have no data until bgrow() gives them a page;
+  // until then they are on no bucket.
+  for(b = bcache.buf; b < bcache.buf+NBUFMAX; b++){
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    if(b < bcache.buf+NBUF){
+      b->data = bcache.data[b - bcache.buf];
+      bpark(b);
+    } else {
+      b->data = 0;
+      b->refcnt = 1;
+    }
+  }
+}
+
+// Find the buffer for (dev, blockno) on bkt.
+// Caller must hold bkt->lock.
+static struct buf*
+bfind(struct bucket *bkt, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bkt->head.next; b != &bkt->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
+// Take the least recently used unused buffer off its bucket,
+// passing over the BPP buffers from skip on, if skip is set.
+// Each bucket is locked in turn, never two at once, so the
+// choice is approximate: the oldest candidate seen by the scan
+// may have been reused by the time its bucket is locked again,
+// in which case we scan again.
+// Returns 0 if every buffer is in use.
+static struct buf*
+bevict(struct buf *skip)
+{
+  struct buf *b, *victim;
+  struct bucket *bkt, *vbkt;
+  uint oldest;
+
+  for(;;){
+    vbkt = 0;
+    oldest = 0;
+    for(bkt = bcache.bucket; bkt < bcache.bucket+NBUCKET; bkt++){
+      acquire(&bkt->lock);
+      for(b = bkt->head.next; b != &bkt->head; b = b->next){
+        if(skip && b >= skip && b < skip+BPP)
+          continue;
+        if(b->refcnt == 0 && (vbkt == 0 || b->lastuse - oldest > (1U<<31))){
+          vbkt = bkt;
+          oldest = b->lastuse;
+        }
+      }
+      release(&bkt->lock);
+    }
+    if(vbkt == 0)
+      return 0;
+
+    // Recheck under the lock, taking this bucket's
+    // oldest unused buffer.
+    acquire(&vbkt->lock);
+    victim = 0;
+    for(b = vbkt->head.next; b != &vbkt->head; b = b->next){
+      if(skip && b >= skip && b < skip+BPP)
+        continue;
+      if(b->refcnt == 0 && (victim == 0 || b->lastuse - victim->lastuse > (1U<<31)))
+        victim = b;
+    }
+    if(victim){
+      bunlink(victim);
+      victim->refcnt = 1;
+      release(&vbkt->lock);
+      if(victim->dev != NODEV)
+        __sync_fetch_and_add(&bcache.nevict, 1);
+      return victim;
+    }
+    release(&vbkt->lock);
+  }
+}
+
+// Back BPP more buffers with a fresh page, if the cache
+// may still grow and memory is available.  Parks all but
+// one, which is returned off any bucket and with refcnt 1.
+// Returns 0 if the cache cannot grow.
+static struct buf*
+bgrow(void)
+{
+  struct buf *b;
+  char *pa;
+  int i;
+
+  acquire(&bcache.growlock);
+  for(i = 0; i < NBUFPAGE; i++){
+    if(bcache.page[i] == 0)
+      break;
+  }
+  if(i == NBUFPAGE || (pa = kalloc_noreclaim()) == 0){
+    release(&bcache.growlock);
+    return 0;
+  }
+  bcache.page[i] = pa;
+  bcache.npage++;
+  bcache.ngrow++;
+  release(&bcache.growlock);
+
+  b = &bcache.buf[NBUF + i*BPP];
+  for(i = 0; i < BPP; i++){
+    b[i].data = (uchar*)pa + i*BSIZE;
+    b[i].lastuse = 0;
+    if(i > 0)
+      bpark(&b[i]);
+  }
+  return b;
+}
+
+// Take b, a buffer on the page from pg on, off its bucket for
+// bshrink(), leaving it with refcnt 1.  If the log has b
+// pinned, but no one is using it, move its block into a spare
+// buffer on some other page first.  Returns 0 if b is in use.
+static int
+bdetach(struct buf *b, struct buf *pg)
+{
+  struct bucket *bkt;
+  struct buf *spare;
+  int ok;
+
+  spare = 0;
+  for(;;){
+    // b's identity can only change while b is off its
+    // bucket with refcnt > 0, so once its bucket is
+    // locked, refcnt == pincnt means b is on that bucket.
+    bkt = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    acquire(&bkt->lock);
+    if(b->refcnt != b->pincnt || bkt != &bcache.bucket[BHASH(b->dev, b->blockno)]){
+      release(&bkt->lock);
+      ok = 0;
+      break;
+    }
+    if(b->refcnt == 0){
+      bunlink(b);
+      b->refcnt = 1;
+      release(&bkt->lock);
+      ok = 1;
+      break;
+    }
+    if(spare){
+      // Only pinned, so no one holds b's lock or data.
+      spare->dev = b->dev;
+      spare->blockno = b->blockno;
+      spare->valid = b->valid;
+      spare->readahead = 0;
+      spare->refcnt = b->refcnt;
+      spare->pincnt = b->pincnt;
+      spare->lastuse = b->lastuse;
+      memmove(spare->data, b->data, BSIZE);
+      blink(bkt, spare);
+      bunlink(b);
+      b->refcnt = 1;
+      b->pincnt = 0;
+      release(&bkt->lock);
+      __sync_fetch_and_add(&bcache.nmove, 1);
+      return 1;
+    }
+    release(&bkt->lock);
+    if((spare = bevict(pg)) == 0)
+      return 0;
+  }
+  if(spare)
+    bpark(spare);
+  return ok;
+}
+
+// Give back to kalloc() pages whose buffers are all unused,
+// at most NSHRINK of them, dropping the blocks they cache.
+// Called by kalloc() when it runs out of memory; must not
+// sleep.  Returns the number of pages freed.
+int
+bshrink(void)
+{
+  struct buf *b;
+  int i, j, n, nfree;
+
+  nfree = 0;
+  acquire(&bcache.growlock);
+  for(i = 0; i < NBUFPAGE && nfree < NSHRINK; i++){
+    if(bcache.page[i] == 0)
+      continue;
+
+    b = &bcache.buf[NBUF + i*BPP];
+    for(n = 0; n < BPP; n++){
+      if(bdetach(&b[n], b) == 0)
+        break;
+    }
+
+    if(n < BPP){
+      // Some buffer is in use; put back the ones taken.
+      for(j = 0; j < n; j++)
+        bpark(&b[j]);
+      continue;
+    }
+
+    for(j = 0; j < BPP; j++)
+      b[j].data = 0;
+    kfree(bcache.page[i]);
+    bcache.page[i] = 0;
+    bcache.npage--;
+    bcache.nshrink++;
+    nfree++;
   }
+  release(&bcache.growlock);
+  return nfree;
+}
+
+static void bput(struct buf*);
+
+// Lock b, which the caller holds a reference to, and return
+// it.  With BTRY, drop the reference and return 0 instead if
+// another process holds the lock.
+static struct buf*
+block(struct buf *b, int mode)
+{
+  if(mode != BTRY){
+    acquiresleep(&b->lock);
+  } else if(!tryacquiresleep(&b->lock)){
+    bput(b);
+    return 0;
+  }
+  return b;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// With BPROBE, return 0 instead if the block is already
+// cached or no buffer is free; with BTRY, if another process
+// holds the buffer locked.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int mode)
 {
-  struct buf *b;
+  struct buf *b, *victim;
+  struct bucket *bkt = &bcache.bucket[BHASH(dev, blockno)];
 
-  acquire(&bcache.lock);
+  acquire(&bkt->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = bfind(bkt, dev, blockno)) != 0){
+    if(mode == BPROBE){
+      release(&bkt->lock);
+      return 0;
     }
+    b->refcnt++;
+    release(&bkt->lock);
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    return block(b, mode);
   }
+  release(&bkt->lock);
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Grow the cache, or else recycle the least recently
+  // used (LRU) unused buffer.  Either way the buffer is
+  // handed over off any bucket and with refcnt 1, so no
+  // one else can find or take it.
+  if((victim = bgrow()) == 0 && (victim = bevict(0)) == 0){
+    if(mode == BPROBE)
+      return 0;
+    panic("bget: no buffers");
+  }
+
+  acquire(&bkt->lock);
+  if((b = bfind(bkt, dev, blockno)) != 0){
+    // Another process cached the block while
+    // bkt->lock was released.
+    if(mode == BPROBE){
+      release(&bkt->lock);
+      bpark(victim);
+      return 0;
+    }
+    b->refcnt++;
+    release(&bkt->lock);
+    bpark(victim);
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    return block(b, mode);
+  }
+  b = victim;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->readahead = 0;
+  blink(bkt, b);
+  release(&bkt->lock);
+  __sync_fetch_and_add(&bcache.nmiss, 1);
+  return block(b, mode);
+}
+
+// Get locked b ready for bsubmit() or bsubmitv().
+static void
+bprepare(struct buf *b, int write, void (*done)(struct buf*))
+{
+  if(!holdingsleep(&b->lock))
+    panic("bsubmit");
+  if(b->disk)
+    panic("bsubmit: busy");
+  // No one else looks at b until the lock is released,
+  // by which time b->data matches the disk.
+  b->valid = 1;
+  b->iodone = done;
+  // A committed block may still be only in the log.
+  b->ioblock = write ? b->blockno : log_block(b->dev, b->blockno);
+  __sync_fetch_and_add(write ? &bcache.nwrite : &bcache.nread, 1);
+}
+
+// Start reading (write == 0) or writing (write == 1) b,
+// which must be locked, and return without waiting.
+// If done is 0, the caller must bwait(b) before using b.
+// Otherwise the disk interrupt handler calls done(b) when
+// the I/O is finished, and done takes over the caller's
+// lock and reference.
+void
+bsubmit(struct buf *b, int write, void (*done)(struct buf*))
+{
+  bprepare(b, write, done);
+  bdev(b->dev)->start(b, write);
+}
+
+// bsubmit() each of the n locked buffers bs[], all for the
+// same device, at once.
+// The disk's elevator orders them, with any others queued,
+// by block number, and merges runs of consecutive blocks.
+void
+bsubmitv(struct buf **bs, int n, int write, void (*done)(struct buf*))
+{
+  int i;
+
+  if(n == 0)
+    return;
+  for(i = 0; i < n; i++)
+    bprepare(bs[i], write, done);
+  bdev(bs[0]->dev)->startv(bs, n, write);
+}
+
+// Wait for I/O started by bsubmit() without a completion
+// function to finish.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  bdev(b->dev)->wait(b);
+}
+
+// Return a locked buf for the indicated block, starting a
+// read of its contents if they are not cached.  Call bwait()
+// before using the data.
+struct buf*
+bread_async(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, BWAIT);
+  if(b->readahead){
+    b->readahead = 0;
+    __sync_fetch_and_add(&bcache.nrahit, 1);
+  }
+  if(!b->valid)
+    bsubmit(b, 0, 0);
+  return b;
+}
+
+// Return in bs[0] a locked buf for block blockno, as
+// bread_async() does, and in bs[1..] locked bufs for as many
+// of the up to n-1 blocks after it as are not cached,
+// stopping at the first that is.  n <= NBATCH.  Reads of all of them that
+// need one are started together.  Returns the number of bufs;
+// call bwait() on each before using the data.
+int
+bread_asyncv(uint dev, uint blockno, int n, struct buf **bs)
+{
+  struct buf *rd[NBATCH];
+  int i, nrd;
+
+  if(n < 1 || n > NBATCH)
+    panic("bread_asyncv");
+  bs[0] = bget(dev, blockno, BWAIT);
+  if(bs[0]->readahead){
+    bs[0]->readahead = 0;
+    __sync_fetch_and_add(&bcache.nrahit, 1);
+  }
+  nrd = 0;
+  if(!bs[0]->valid)
+    rd[nrd++] = bs[0];
+  // Probing never waits for a buffer lock, so holding
+  // bs[0] meanwhile cannot deadlock.
+  for(i = 1; i < n; i++){
+    if((bs[i] = bget(dev, blockno + i, BPROBE)) == 0)
+      break;
+    if(bs[i]->valid){
+      brelse(bs[i]);
+      break;
     }
+    rd[nrd++] = bs[i];
   }
-  panic("bget: no buffers");
+  bsubmitv(rd, nrd, 0, 0);
+  return i;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,10 +589,24 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
-  if(!b->valid) {
-    virtio_disk_rw(b, 0);
-    b->valid = 1;
+  b = bread_async(dev, blockno);
+  bwait(b);
+  return b;
+}
+
+// Like bread(), but return 0 without waiting if another
+// process holds the block's buffer locked, so that a caller
+// holding other buffers locked cannot deadlock with it.
+struct buf*
+bread_try(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, BTRY)) == 0)
+    return 0;
+  if(!b->valid){
+    bsubmit(b, 0, 0);
+    bwait(b);
   }
   return b;
 }
@@ -108,11 +617,30 @@ bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  b->ioblock = b->blockno;
+  __sync_fetch_and_add(&bcache.nwrite, 1);
+  bdev(b->dev)->start(b, 1);
+  bdev(b->dev)->wait(b);
+}
+
+// Drop a reference to an unlocked buffer.
+// Stamp it as the most recently used if no one else holds it.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bkt;
+
+  bkt = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bkt->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->lastuse = __sync_fetch_and_add(&bcache.clock, 1);
+  }
+  release(&bkt->lock);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +648,110 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Called by the disk driver when a read started by
+// breadahead() is done.  The buffer was locked on behalf of
+// the process that started the read; release it for it.
+static void
+breaddone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Start reading blocks blockno..blockno+n-1 into the cache,
+// those that are not already there, and return without
+// waiting for them.  Consecutive ones go to the disk as
+// single requests.
+void
+breadaheadv(uint dev, uint blockno, int n)
+{
+  struct buf *rd[NBATCH], *b;
+  int i, nrd;
+
+  nrd = 0;
+  for(i = 0; i < n; i++){
+    if((b = bget(dev, blockno + i, BPROBE)) == 0)
+      continue;
+    if(b->valid){
+      brelse(b);
+      continue;
+    }
+    b->readahead = 1;
+    rd[nrd++] = b;
+    if(nrd == NBATCH){
+      __sync_fetch_and_add(&bcache.nra, nrd);
+      bsubmitv(rd, nrd, 0, breaddone);
+      nrd = 0;
+    }
   }
-  
-  release(&bcache.lock);
+  __sync_fetch_and_add(&bcache.nra, nrd);
+  bsubmitv(rd, nrd, 0, breaddone);
+}
+
+// Start reading the indicated block into the cache, unless
+// it is already there, and return without waiting for it.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, BPROBE)) == 0)
+    return;
+  if(b->valid){
+    // Another process read it while we waited for the lock.
+    brelse(b);
+    return;
+  }
+  b->readahead = 1;
+  __sync_fetch_and_add(&bcache.nra, 1);
+  bsubmit(b, 0, breaddone);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bkt = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bkt->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  b->pincnt++;
+  release(&bkt->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bkt = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bkt->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  b->pincnt--;
+  release(&bkt->lock);
 }
 
+// Report cache effectiveness and bucket lock contention
+// for the fsstats device.
+int
+statsbio(char *buf, int sz)
+{
+  struct bucket *bkt;
+  uint n, nts;
 
+  n = nts = 0;
+  for(bkt = bcache.bucket; bkt < bcache.bucket+NBUCKET; bkt++){
+    n += bkt->lock.n;
+    nts += bkt->lock.nts;
+  }
+  return snprintf(buf, sz,
+                  "bcache: buffers %d max %d grow %d shrink %d move %d\n"
+                  "bcache: hit %d miss %d evict %d\n"
+                  "bcache: readahead %d used %d\n"
+                  "bcache: disk reads %d writes %d\n"
+                  "bcache: buckets %d #acquire() %d #test-and-set %d\n",
+                  NBUF + bcache.npage*BPP, NBUFMAX, bcache.ngrow, bcache.nshrink, bcache.nmove,
+                  bcache.nhit, bcache.nmiss, bcache.nevict,
+                  bcache.nra, bcache.nrahit,
+                  bcache.nread, bcache.nwrite,
+                  NBUCKET, n, nts);
+}
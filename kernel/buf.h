@@ -1,12 +1,35 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int readahead; // read by breadahead(), not yet by bread()?
   uint dev;
   uint blockno;
+  uint ioblock;     // block the disk reads or writes for blockno
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint pincnt;      // references held by bpin(), of refcnt
+  uint lastuse;     // bcache.clock at last brelse(), for LRU
+  struct buf *prev; // hash bucket list
   struct buf *next;
-  uchar data[BSIZE];
+  void (*iodone)(struct buf*); // if set, the disk driver calls it when I/O is done
+  struct buf *qnext; // elevator queue
+  int qwrite;       // queued to be written?
+  uint qtime;       // ticks when queued
+  uchar *data;      // BSIZE bytes
 };
 
+// How bio reaches the disk that holds device dev's blocks:
+// bdevsw[dev], which the disk's driver fills in with
+// bregister().  start(b, write) and startv(bs, n, write)
+// begin I/O on locked bufs, set b->disk until it is done, and
+// then call b->iodone, if set; wait(b) waits for I/O on b to
+// finish if b->iodone was not set.
+struct bdevsw {
+  void (*start)(struct buf*, int);
+  void (*startv)(struct buf**, int, int);
+  void (*wait)(struct buf*);
+  int unit;         // the driver's own number for the disk
+};
+
+extern struct bdevsw bdevsw[];
+
@@ -1,7 +1,10 @@
+struct bdevsw;
 struct buf;
 struct context;
+struct elevator;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -16,10 +19,21 @@ struct sock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bread_async(uint, uint);
+struct buf*     bread_try(uint, uint);
+int             bread_asyncv(uint, uint, int, struct buf**);
+void            breadahead(uint, uint);
+void            breadaheadv(uint, uint, int);
+void            bsubmit(struct buf*, int, void (*)(struct buf*));
+void            bsubmitv(struct buf**, int, int, void (*)(struct buf*));
+int             bregister(struct bdevsw*);
+void            bwait(struct buf*);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+int             statsbio(char*, int);
 
 // console.c
 void            consoleinit(void);
@@ -35,15 +49,31 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, uint64, int, uint);
 int             filestat(struct file*, uint64 addr);
+int             filegetdents(struct file*, uint64, int, int);
 int             filewrite(struct file*, uint64, int n);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepwrite(struct file*, uint64, int, uint);
+int             filesendfile(struct file*, struct file*, int);
+int             filesync(struct file*);
+int             filefallocate(struct file*, uint, uint);
+int             filesetmap(struct file*, int);
 
 // fs.c
 void            fsinit(int);
+int             fsmount(int, struct inode*);
+int             mounted(struct inode*);
 int             dirlink(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
+void            iflush(struct inode*);
+void            iflushd(void);
+int             iprealloc(struct inode*, uint, uint, int);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -57,6 +87,8 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+int             ishrink(void);
+int             statsfs(char*, int);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -65,20 +97,29 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_noreclaim(void);
 void            kfree(void *);
 void            kinit(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_force(int);
+uint            log_tx(int);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
+int             log_opblocks(void);
+uint            log_block(uint, uint);
+int             statslog(char*, int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -93,6 +134,7 @@ int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            kproc(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -123,6 +165,7 @@ void            pop_off(void);
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -183,6 +226,7 @@ void            vmprint(pagetable_t);
 void            vmprint_t(pagetable_t, int);
 void            vminit(pagetable_t pagetable);
 void            vmmap(pagetable_t, uint64, uint64, uint64, int);
+void            vmmapmega(pagetable_t, uint64, uint64, uint64, int);
 uint64          vmpa(pagetable_t, uint64);
 void            free_pagetable(pagetable_t pagetable);
 void            free_pagetable_t(pagetable_t, int);
@@ -195,10 +239,21 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// ramdisk.c
+void            ramdiskinit(void);
+
+// elevator.c
+void            elvadd(struct elevator*, struct buf*, int);
+int             elvnext(struct elevator*, struct buf**, int, int*);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
-void            virtio_disk_intr(void);
+void            virtio_disk_start(struct buf *, int);
+void            virtio_disk_startv(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+int             virtio_disk_poll(int);
+void            virtio_disk_intr(int);
+int             statsdisk(char*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
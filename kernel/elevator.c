@@ -0,0 +1,93 @@
+//
+// Elevator scheduling of disk requests.
+//
+// A disk driver that has more requests than it wants the
+// device to have at once queues the rest here.  The queue is
+// kept sorted by disk block, and elvnext() hands them out in
+// one direction, upward from the end of the last request,
+// wrapping around to the lowest block at the top (C-SCAN),
+// so that a burst of requests in any order reaches the device
+// in block order.  Each request it returns carries as many
+// queued bufs for consecutive blocks, all reads or all
+// writes, as the caller can take.  A buf queued for more
+// than EXPIRE ticks goes next regardless, so that a stream
+// of requests near the head cannot starve it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "elevator.h"
+
+#define EXPIRE 10
+
+// Queue b, to be written if write is set or else read.
+void
+elvadd(struct elevator *e, struct buf *b, int write)
+{
+  struct buf **pp;
+
+  b->qwrite = write;
+  b->qtime = ticks;
+  for(pp = &e->head; *pp && (*pp)->ioblock <= b->ioblock; pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
+  e->nqueued++;
+  if(++e->n > e->maxn)
+    e->maxn = e->n;
+}
+
+// Remove the next request from the queue: up to max bufs for
+// consecutive blocks, put in bs[], all to be read or all to
+// be written, as *write says.  Returns how many, 0 if the
+// queue is empty.
+int
+elvnext(struct elevator *e, struct buf **bs, int max, int *write)
+{
+  struct buf **pp, **pstart, **poldest, *b;
+  int n;
+
+  if(e->head == 0 || max < 1)
+    return 0;
+
+  // find the first buf at or past pos, and the oldest.
+  pstart = 0;
+  poldest = &e->head;
+  for(pp = &e->head; *pp; pp = &(*pp)->qnext){
+    if(pstart == 0 && (*pp)->ioblock >= e->pos)
+      pstart = pp;
+    if((*pp)->qtime < (*poldest)->qtime)
+      poldest = pp;
+  }
+  if(ticks - (*poldest)->qtime > EXPIRE){
+    pstart = poldest;
+    e->nexpired++;
+  } else if(pstart == 0){
+    pstart = &e->head;   // wrap around
+  }
+
+  // take the run of consecutive blocks that starts there.
+  b = *pstart;
+  *write = b->qwrite;
+  for(n = 0; ; n++){
+    bs[n] = b;
+    e->waitticks += ticks - b->qtime;
+    if(n + 1 == max || b->qnext == 0 || b->qnext->qwrite != *write ||
+       b->qnext->ioblock != b->ioblock + 1)
+      break;
+    b = b->qnext;
+  }
+  n++;
+  *pstart = b->qnext;
+  e->pos = b->ioblock + 1;
+  e->n -= n;
+  e->nreq++;
+  e->nmerged += n - 1;
+  return n;
+}
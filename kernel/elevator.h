@@ -0,0 +1,17 @@
+// A disk's queue of block requests that it has not yet
+// given to the device, kept sorted by disk block.
+// The driver adds bufs with elvadd() and takes requests with
+// elvnext(), under its own lock.
+struct elevator {
+  struct buf *head;  // queued bufs, by ioblock, linked by qnext
+  int n;             // how many
+  uint pos;          // the block after the last request taken
+
+  // statistics.
+  uint nqueued;      // bufs added
+  uint nreq;         // requests taken ...
+  uint nmerged;      // ... and the bufs that joined another's
+  uint nexpired;     // requests taken out of order for a deadline
+  int maxn;          // most bufs queued at once
+  uint waitticks;    // ticks bufs spent queued, summed
+};
@@ -12,6 +12,9 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "uio.h"
+
+#define GDBATCH 16  // directory entries filegetdents() reads at a time
 
 struct devsw devsw[NDEV];
 struct {
@@ -55,6 +58,19 @@ filedup(struct file *f)
   return f;
 }
 
+// Give the data of inode file f that is waiting in memory
+// for disk blocks (see iflush()) its blocks, and start it on
+// its way to disk with the next commit.
+static void
+fileflush(struct file *f)
+{
+  begin_op();
+  ilock(f->ip);
+  iflush(f->ip);
+  iunlock(f->ip);
+  end_op();
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void
 fileclose(struct file *f)
@@ -76,6 +92,10 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
+    // Unlocked peek: a writer that races with it
+    // closes its own file later.
+    if(ff.type == FD_INODE && ff.writable && ff.ip->dpage)
+      fileflush(&ff);
     begin_op();
     iput(ff.ip);
     end_op();
@@ -101,32 +121,242 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Read directory entries from f, which must be a directory,
+// into the user array addr of up to n struct dirstat, going on
+// from f->off.  With GD_STAT in flags, include the stat of each
+// entry's inode.  Returns the number of entries read, 0 at the
+// end of the directory, or -1.
 int
-fileread(struct file *f, uint64 addr, int n)
+filegetdents(struct file *f, uint64 addr, int n, int flags)
 {
-  int r = 0;
+  struct proc *p = myproc();
+  struct dirent de[GDBATCH];
+  struct inode *ip[GDBATCH];
+  struct dirstat ds;
+  struct inode *dp;
+  int i, m, r, tot, err;
 
-  if(f->readable == 0)
+  if(f->type != FD_INODE || !f->readable || n < 0)
     return -1;
-
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+  dp = f->ip;
+  tot = 0;
+  err = 0;
+  while(tot < n && !err){
+    m = n - tot < GDBATCH ? n - tot : GDBATCH;
+    if(flags & GD_STAT)
+      begin_op();   // for iput()
+    ilock(dp);
+    if(dp->type != T_DIR){
+      iunlock(dp);
+      if(flags & GD_STAT)
+        end_op();
       return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
+    }
+    r = readi(dp, 0, (uint64)de, f->off, m*sizeof(de[0])) / sizeof(de[0]);
+    f->off += r*sizeof(de[0]);
+
+    // While dp is locked its entries' inodes cannot be freed,
+    // so take references to them now, and lock them one at a
+    // time after unlocking dp.  The ".." of a directory that
+    // has been removed may name a freed inode; skip it.
+    for(i = 0; i < r; i++){
+      ip[i] = 0;
+      if((flags & GD_STAT) && de[i].inum != 0 &&
+         (dp->nlink > 0 || de[i].inum == dp->inum))
+        ip[i] = iget(dp->dev, de[i].inum);
+    }
+    iunlock(dp);
+
+    for(i = 0; i < r; i++){
+      if(de[i].inum == 0)
+        continue;
+      memset(&ds, 0, sizeof(ds));
+      ds.ino = de[i].inum;
+      memmove(ds.name, de[i].name, DIRSIZ);
+      if(ip[i]){
+        ilock(ip[i]);
+        stati(ip[i], &ds.st);
+        iunlockput(ip[i]);
+      }
+      if(!err && copyout(p->pagetable, addr + tot*sizeof(ds), (char*)&ds, sizeof(ds)) < 0)
+        err = 1;
+      tot++;
+    }
+    if(flags & GD_STAT)
+      end_op();
+    if(r < m)
+      break;   // end of directory
+  }
+  return err ? -1 : tot;
+}
+
+// Read the cnt buffers iov[] in turn from inode file f,
+// starting at *poff, and advance *poff past what was read.
+// Returns the number of bytes read.
+static int
+inodereadv(struct file *f, struct iovec *iov, int cnt, uint *poff)
+{
+  int i, r, tot;
+
+  tot = 0;
+  ilock(f->ip);
+  for(i = 0; i < cnt; i++){
+    r = readi(f->ip, 1, (uint64)iov[i].iov_base, *poff, iov[i].iov_len);
+    if(r > 0){
+      *poff += r;
+      tot += r;
+    }
+    if(r != iov[i].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
+// Write the cnt buffers iov[] in turn to inode file f,
+// starting at *poff, and advance *poff past what was written.
+// If user_src==1, the buffers are user virtual addresses;
+// otherwise, kernel addresses.  Returns the number of bytes
+// written, or -1 if that is not all of them.
+static int
+inodewritev(struct file *f, int user_src, struct iovec *iov, int cnt, uint *poff)
+{
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  // The buffers are written to consecutive bytes of the
+  // file, so one transaction may take pieces of several.
+  int opblocks = log_opblocks();
+  int max = ((opblocks-1-1-2) / 2) * BSIZE;
+  int i, n, n1, r, off, tot, room, ok;
+  uint64 sum;
+
+  sum = 0;
+  for(i = 0; i < cnt; i++)
+    sum += iov[i].iov_len;
+  if(sum > IOV_TOTMAX)
+    return -1;
+  n = sum;
+
+  i = 0;    // iov[i] is being written ...
+  off = 0;  // ... from byte off on
+  tot = 0;
+  ok = 1;
+  while(ok && tot < n){
+    begin_opn(opblocks);
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    for(room = max; room > 0 && tot < n; i++, off = 0){
+      n1 = iov[i].iov_len - off;
+      if(n1 > room)
+        n1 = room;
+      r = writei(f->ip, user_src, (uint64)iov[i].iov_base + off, *poff, n1);
+      if(r > 0){
+        *poff += r;
+        tot += r;
+        room -= r;
+        off += r;
+      }
+      if(r != n1){
+        ok = 0;    // e.g. the file cannot grow any more
+        break;
+      }
+      if(off < iov[i].iov_len)
+        break;     // the rest of iov[i] goes in the next transaction
+    }
     iunlock(f->ip);
-  } else {
-    panic("fileread");
+    end_opn(opblocks);
   }
+  return tot == n ? n : -1;
+}
 
-  return r;
+// Read into the cnt user buffers iov[] from file f.
+// Returns the number of bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_INODE)
+    return inodereadv(f, iov, cnt, &f->off);
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(f->type == FD_PIPE){
+      r = piperead(f->pipe, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+        return -1;
+      r = devsw[f->major].read(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else {
+      panic("fileread");
+    }
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Write the cnt buffers iov[] to file f.  If user_src==1,
+// they are user virtual addresses; otherwise, kernel addresses.
+// Returns the number of bytes written, or -1.
+static int
+dowritev(struct file *f, int user_src, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_INODE)
+    return inodewritev(f, user_src, iov, cnt, &f->off);
+
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(f->type == FD_PIPE){
+      r = pipewrite(f->pipe, user_src, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+        return -1;
+      r = devsw[f->major].write(user_src, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else {
+      panic("filewrite");
+    }
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Write the cnt user buffers iov[] to file f.
+// Returns the number of bytes written, or -1.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  return dowritev(f, 1, iov, cnt);
+}
+
+// Read from file f.
+// addr is a user virtual address.
+int
+fileread(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1);
 }
 
 // Write to file f.
@@ -134,49 +364,151 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
 
-  if(f->writable == 0)
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1);
+}
+
+// Read from file f at byte off, leaving f->off alone.
+// f must be an inode.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->readable == 0 || f->type != FD_INODE)
     return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodereadv(f, &iov, 1, &off);
+}
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
-      return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
+// Write to file f at byte off, leaving f->off alone.
+// f must be an inode.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
 
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodewritev(f, 1, &iov, 1, &off);
+}
+
+// Copy up to n bytes from inode file in, starting at in->off,
+// to file out, without a trip through user space: a page at
+// a time, readi() copies from the buffer cache into a kernel
+// page, and out's write copies from there.  That is still two
+// copies.  Writing from the cached source buffers themselves
+// would hold them locked across out's write, which may wait
+// in begin_op() for a commit that needs one of them, or for a
+// sendfile() the other way that holds the destination's.
+// in is unlocked while out is written, so in and out may be
+// the same inode.
+// Advances both offsets.  Returns the number of bytes copied,
+// 0 at the end of in, or -1.
+int
+filesendfile(struct file *out, struct file *in, int n)
+{
+  struct iovec iov;
+  char *page;
+  int r, tot;
+
+  if(in->readable == 0 || in->type != FD_INODE || out->writable == 0 || n < 0)
+    return -1;
+  if((page = kalloc()) == 0)
+    return -1;
+
+  tot = 0;
+  while(tot < n){
+    ilock(in->ip);
+    r = readi(in->ip, 0, (uint64)page, in->off, n - tot < PGSIZE ? n - tot : PGSIZE);
+    if(r > 0)
+      in->off += r;
+    iunlock(in->ip);
+    if(r <= 0)
+      break;
+
+    iov.iov_base = page;
+    iov.iov_len = r;
+    if(dowritev(out, 0, &iov, 1) != r){
+      if(tot == 0)
+        tot = -1;
+      break;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    tot += r;
   }
+  kfree(page);
+  return tot;
+}
+
+
+// Write inode file f's data to disk, and wait for the
+// transaction that does so to commit.
+int
+filesync(struct file *f)
+{
+  if(f->type != FD_INODE)
+    return -1;
+  fileflush(f);
+  log_force(f->ip->dev);
+  return 0;
+}
 
-  return ret;
+// Make regular file f, which must be writable and empty, map
+// its blocks by extents (FM_EXTENTS) or by direct and indirect
+// block numbers (FM_BLOCKS).  Blocks fallocate() reserved past
+// the end are given back.
+int
+filesetmap(struct file *f, int map)
+{
+  struct inode *ip = f->ip;
+  int r = -1;
+
+  if(f->type != FD_INODE || f->writable == 0)
+    return -1;
+  begin_op();
+  ilock(ip);
+  if(ip->type == T_FILE && ip->size == 0 && ip->dpage == 0){
+    itrunc(ip);
+    if(map == FM_EXTENTS)
+      ip->flags |= I_EXTENT;
+    else
+      ip->flags &= ~I_EXTENT;
+    iupdate(ip);
+    r = 0;
+  }
+  iunlock(ip);
+  end_op();
+  return r;
 }
 
+// Reserve disk blocks for bytes off..off+len-1 of inode file f,
+// in as few contiguous runs as free space allows, without
+// changing its size, in one transaction: either all of them
+// are reserved or none are.  A range that needs more runs
+// than a transaction can log fails, as does one in a file that
+// maps its blocks by indirect blocks (see fsetmap()).
+int
+filefallocate(struct file *f, uint off, uint len)
+{
+  int opblocks = log_opblocks();
+  int r;
+
+  if(f->type != FD_INODE || f->writable == 0)
+    return -1;
+  if(off + len < off || (uint64)off + len > (uint64)MAXFILE*BSIZE)
+    return -1;
+  begin_opn(opblocks);
+  ilock(f->ip);
+  // Leave room for the inode, and for etrim() to undo.
+  r = iprealloc(f->ip, off / BSIZE, (off % BSIZE + len + BSIZE - 1) / BSIZE,
+                opblocks - 3);
+  iunlock(f->ip);
+  end_opn(opblocks);
+  return r;
+}
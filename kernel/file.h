@@ -25,6 +25,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // icache hash chain
+  struct inode *prev; // icache LRU list of unused inodes
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -33,10 +36,23 @@ struct inode {
   short minor;
   short nlink;
   uint size;
+  uint flags;
 #ifdef SOL_FS
 #else
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+3];
 #endif
+
+  uint ranext;        // block after the last one readi() read
+  uint rawin;         // read-ahead window, in blocks; 0 if off
+  uint raend;         // read-ahead has been started up to here
+  uint goal;          // where to look for the next block to allocate
+
+  char *dpage;        // written data not yet given disk blocks, or 0
+  uint dstart;        // file block held at the start of dpage
+  uint dn;            // blocks of dpage in use
+  uint dtime;         // ticks when dpage was filled
+  uint pstart;        // eappend() preallocated file blocks pstart..pend-1
+  uint pend;          // ... if pend is not 0
 };
 
 // map major device number to device functions.
@@ -49,3 +65,4 @@ extern struct devsw devsw[];
 
 #define CONSOLE 1
 #define STATS   2
+#define FSSTATS 3
@@ -22,9 +22,40 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
-// there should be one superblock per disk device, but we run with
-// only one device
-struct superblock sb; 
+// one superblock per disk device, indexed by device number.
+struct superblock sb[NBDEV];
+
+// Counters for the fsstats device.
+static struct {
+  uint nlookup;    // block map lookups by readi() and writei()
+  uint nblock;     // ... and the blocks they resolved
+  uint nballoc;    // balloc_goal() calls
+  uint nbitmap;    // ... bitmap blocks they read
+  uint nbits;      // ... and bitmap bits they examined
+  uint ndelay;     // blocks written with their allocation delayed
+  uint nflush;     // iflush() calls that had blocks to allocate
+  uint nsweep;     // ... of them by iflushd()
+  uint nprealloc;  // preallocation windows eappend() reserved
+  uint nprefree;   // ... and their blocks given back unused
+  uint nfreed;     // words of bits passed over as freed but uncommitted
+} fsstat;
+
+// The mount table, indexed by device number: on is the
+// directory the device's file system covers, root is the
+// file system's root directory.  Each holds a reference to
+// both; a slot whose root is 0 is still being mounted.
+static struct {
+  struct spinlock lock;
+  struct {
+    struct inode *on;
+    struct inode *root;
+  } m[NBDEV];
+} mtab;
+
+static void bcount(uint);
+static void dcinit(void);
+static void dcpurge(struct inode*);
+static void iunprealloc(struct inode*);
 
 // Read the super block.
 static void
@@ -40,10 +71,11 @@ readsb(int dev, struct superblock *sb)
 // Init fs
 void
 fsinit(int dev) {
-  readsb(dev, &sb);
-  if(sb.magic != FSMAGIC)
+  readsb(dev, &sb[dev]);
+  if(sb[dev].magic != FSMAGIC)
     panic("invalid file system");
-  initlog(dev, &sb);
+  initlog(dev, &sb[dev]);
+  bcount(dev);
 }
 
 // Zero a block.
@@ -60,48 +92,286 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// The number of free blocks that each bitmap block of each
+// device describes, so that balloc_goal() can pass over full
+// ones without reading them.  Counted by bcount() when the
+// file system is mounted; after that, an entry only changes
+// while its bitmap block is locked.
+static uint nfree[NBDEV][FSSIZE/BPB + 1];
+
+// Blocks that the open transaction has freed, a bit per block
+// as in the bitmap, which the allocator passes over until that
+// transaction commits.  Otherwise a freed indirect block, say,
+// could be written over with file data, which commit() writes
+// home before the header (see log.c), while the inode that
+// still points at it is all that is on disk.  tx[i] is the
+// transaction that freed[i]'s bits belong to; bits from an
+// older one are stale.  An entry only changes while its
+// bitmap block is locked.
+static struct {
+  uint64 freed[FSSIZE/BPB + 1][BSIZE/8];
+  uint tx[FSSIZE/BPB + 1];
+  uint n[FSSIZE/BPB + 1];       // bits set in freed[i]
+} bpend[NBDEV];
+
+// Count the free blocks in each bitmap block.
+static void
+bcount(uint dev)
+{
+  struct buf *bp;
+  uint b, bi;
+
+  if((sb[dev].size + BPB - 1) / BPB > NELEM(nfree[0]))
+    panic("bcount: file system too large");
+  for(b = 0; b < sb[dev].size; b += BPB){
+    bp = bread(dev, BBLOCK(b, sb[dev]));
+    nfree[dev][b/BPB] = 0;
+    for(bi = 0; bi < BPB && b + bi < sb[dev].size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        nfree[dev][b/BPB]++;
+    }
+    brelse(bp);
+  }
+}
+
+// About how many blocks of dev are free: an unlocked sum of
+// nfree[], which also counts blocks the open transaction freed.
 static uint
-balloc(uint dev)
+bavail(uint dev)
+{
+  uint b, n;
+
+  n = 0;
+  for(b = 0; b < sb[dev].size; b += BPB)
+    n += nfree[dev][b/BPB];
+  return n;
+}
+
+// The bits of the blocks that the open transaction has freed
+// from bitmap block b/BPB of dev, or 0 if there are none.
+// Caller must hold that bitmap block.
+static uint64*
+bfreed(uint dev, uint b)
+{
+  uint tx = log_tx(dev);
+  int i = b / BPB;
+
+  if(bpend[dev].tx[i] != tx){
+    if(bpend[dev].n[i] > 0)
+      memset(bpend[dev].freed[i], 0, BSIZE);
+    bpend[dev].n[i] = 0;
+    bpend[dev].tx[i] = tx;
+  }
+  return bpend[dev].n[i] > 0 ? bpend[dev].freed[i] : 0;
+}
+
+// Mark block b of dev freed by the open transaction.
+// Caller must hold b's bitmap block.
+static void
+bpendfree(uint dev, uint b)
+{
+  uint64 *f;
+  int bi;
+
+  bfreed(dev, b);
+  f = bpend[dev].freed[b / BPB];
+  bi = b % BPB;
+  f[bi/64] |= 1UL << (bi % 64);
+  bpend[dev].n[b / BPB]++;
+}
+
+// Return the first clear bit among bits start..end-1 of
+// bitmap block data that is not set in freed either, if
+// freed is not 0, or -1 if there is none.  Tests 64 bits at a
+// time; on little-endian RISC-V, bit bi of the bitmap is bit
+// bi%64 of the bi/64th uint64.
+static int
+bfind(uchar *data, uint64 *freed, int start, int end)
+{
+  uint64 *w, x;
+  int i, bi;
+
+  w = (uint64*)data;
+  for(i = start/64; i*64 < end; i++){
+    x = ~w[i];
+    if(i == start/64)
+      x &= ~0UL << (start % 64);
+    if(freed && (x & freed[i])){
+      __sync_fetch_and_add(&fsstat.nfreed, 1);
+      x &= ~freed[i];
+    }
+    if(x == 0)
+      continue;
+    bi = i*64;
+    for(; (x & 0xff) == 0; x >>= 8)
+      bi += 8;
+    for(; (x & 1) == 0; x >>= 1)
+      bi++;
+    if(bi >= end)
+      break;
+    __sync_fetch_and_add(&fsstat.nbits, bi + 1 - start);
+    return bi;
+  }
+  __sync_fetch_and_add(&fsstat.nbits, end - start);
+  return -1;
+}
+
+// Allocate a zeroed disk block: goal, if it is free, or
+// else the first free block after it, wrapping around.
+static uint
+balloc_goal(uint dev, uint goal)
 {
-  int b, bi, m;
+  int b, bi, k, nb, start, end;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+  if(goal >= sb[dev].size)
+    goal = 0;
+  nb = (sb[dev].size + BPB - 1) / BPB;
+  __sync_fetch_and_add(&fsstat.nballoc, 1);
+
+  // The goal's bitmap block is scanned from the goal on
+  // first, and up to the goal last.  nfree[] counts blocks that
+  // the open transaction freed, so a bitmap block may turn out
+  // to have none to give.
+  for(k = 0; k <= nb; k++){
+    b = ((goal / BPB + k) % nb) * BPB;
+    if(nfree[dev][b/BPB] == 0)
+      continue;
+    start = (k == 0 ? goal % BPB : 0);
+    end = (k == nb ? goal % BPB : BPB);
+    if(end > sb[dev].size - b)
+      end = sb[dev].size - b;
+    __sync_fetch_and_add(&fsstat.nbitmap, 1);
+    bp = bread(dev, BBLOCK(b, sb[dev]));
+    if((bi = bfind(bp->data, bfreed(dev, b), start, end)) >= 0){
+      bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+      nfree[dev][b/BPB]--;
+      log_write(bp);
+      brelse(bp);
+      bzero(dev, b + bi);
+      return b + bi;
+    }
+    brelse(bp);
+  }
+  panic("balloc: out of blocks");
+}
+
+// Allocate n free disk blocks in a row, 1 <= n <= BPB, from
+// the first run of them at or after goal, wrapping around.
+// Each bitmap block is searched on its own, so a run does not
+// cross from one into the next.  Unlike balloc_goal(), does
+// not zero the blocks.  Returns the first, or 0 if there is no
+// such run.
+static uint
+balloc_run(uint dev, uint goal, uint n)
+{
+  int b, bi, bj, k, nb, start, end;
+  struct buf *bp;
+  uint64 *f;
+
+  if(goal >= sb[dev].size)
+    goal = 0;
+  nb = (sb[dev].size + BPB - 1) / BPB;
+  __sync_fetch_and_add(&fsstat.nballoc, 1);
+
+  for(k = 0; k <= nb; k++){
+    b = ((goal / BPB + k) % nb) * BPB;
+    if(nfree[dev][b/BPB] < n)
+      continue;
+    start = (k == 0 ? goal % BPB : 0);
+    end = (k == nb ? goal % BPB + n - 1 : BPB);
+    if(end > BPB)
+      end = BPB;
+    if(end > sb[dev].size - b)
+      end = sb[dev].size - b;
+    __sync_fetch_and_add(&fsstat.nbitmap, 1);
+    bp = bread(dev, BBLOCK(b, sb[dev]));
+    f = bfreed(dev, b);
+    while((bi = bfind(bp->data, f, start, end)) >= 0 && bi + n <= end){
+      for(bj = bi + 1; bj < bi + n; bj++){
+        if(bp->data[bj/8] & (1 << (bj % 8)))
+          break;
+        if(f && (f[bj/64] & (1UL << (bj % 64))))
+          break;
+      }
+      if(bj == bi + n){
+        for(bj = bi; bj < bi + n; bj++)
+          bp->data[bj/8] |= 1 << (bj % 8);
+        nfree[dev][b/BPB] -= n;
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
         return b + bi;
       }
+      start = bj + 1;   // bj is in use
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return 0;
+}
+
+// Allocate a zeroed disk block.
+static uint
+balloc(uint dev)
+{
+  return balloc_goal(dev, 0);
+}
+
+// Allocate a zeroed disk block for inode ip, looking from goal
+// or, if goal is 0, from just after the last one allocated for ip.
+static uint
+balloc_inode(struct inode *ip, uint goal)
+{
+  uint addr;
+
+  if(goal == 0)
+    goal = ip->goal;
+  addr = balloc_goal(ip->dev, goal);
+  ip->goal = addr + 1;
+  return addr;
 }
 
-// Free a disk block.
+// Free a disk block.  It can be allocated again once the
+// transaction commits.
 static void
 bfree(int dev, uint b)
 {
   struct buf *bp;
   int bi, m;
 
-  bp = bread(dev, BBLOCK(b, sb));
+  bp = bread(dev, BBLOCK(b, sb[dev]));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bpendfree(dev, b);
+  nfree[dev][b/BPB]++;
   log_write(bp);
   brelse(bp);
 }
 
+// Free the n disk blocks starting at b.
+static void
+bfreerun(int dev, uint b, uint n)
+{
+  struct buf *bp;
+  int bi, m;
+
+  while(n > 0){
+    bp = bread(dev, BBLOCK(b, sb[dev]));
+    for(bi = b % BPB; bi < BPB && n > 0; bi++, b++, n--){
+      m = 1 << (bi % 8);
+      if((bp->data[bi/8] & m) == 0)
+        panic("freeing free block");
+      bp->data[bi/8] &= ~m;
+      bpendfree(dev, b);
+      nfree[dev][b/BPB]++;
+    }
+    log_write(bp);
+    brelse(bp);
+  }
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -127,18 +397,19 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to an entry in the inode cache (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref.  An entry whose ref is zero is unused,
+//   and may be recycled for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid when it
+//   frees the inode.  An unused entry stays valid, so
+//   that the next iget() of its inode need not read it.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,32 +433,169 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// The cache is a hash table of entries, keyed by (dev, inum),
+// with the unused entries also on an LRU list.  iget() recycles
+// first an unused entry that holds no inode, then one from a
+// newly allocated page, while the cache is smaller than
+// NINODEMAX, and then the least recently used one.  When kalloc()
+// runs out of memory it calls ishrink() to take back pages whose
+// entries are all unused.
+//
 // The icache.lock spin-lock protects the allocation of icache
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock while using any of those
+// fields, or the hash chains and LRU list.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+#define IHASH(dev, inum) ((((dev) << 27) | (inum)) % NIHASH)
+
+#define IPP (PGSIZE / sizeof(struct inode))             // inodes per kalloc'd page
+#define NIPAGE ((NINODEMAX - NINODE + IPP - 1) / IPP)  // pages the cache may grow by
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode lru;  // unused entries, most recently used first.
+
+  // page[i] holds IPP more entries, if not 0.
+  struct inode *page[NIPAGE];
+  int npage;
+
+  // statistics.
+  uint nhit;
+  uint nmiss;
+  uint nevict;
+  uint ngrow;
+  uint nshrink;
+
+  int reclaim;       // kalloc() ran short; see iflushd().
 } icache;
 
+// Put ip on the LRU list: first, if it holds an inode,
+// so that it is recycled last; otherwise last.
+static void
+ilink(struct inode *ip)
+{
+  struct inode *after;
+
+  after = ip->inum ? &icache.lru : icache.lru.prev;
+  ip->next = after->next;
+  ip->prev = after;
+  after->next->prev = ip;
+  after->next = ip;
+}
+
+static void
+iunlink(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Take ip off its hash chain, leaving it holding no inode.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+  ip->dev = 0;
+  ip->inum = 0;
+  ip->valid = 0;
+}
+
+// Prepare the n entries at ip, which hold no inodes, for use.
+static void
+iprepare(struct inode *ip, int n)
+{
+  for(; n > 0; n--, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->dev = 0;
+    ip->inum = 0;
+    ip->ref = 0;
+    ip->valid = 0;
+    ilink(ip);
+  }
+}
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+  initlock(&mtab.lock, "mtab");
+  dcinit();
+  icache.lru.prev = &icache.lru;
+  icache.lru.next = &icache.lru;
+  iprepare(icache.inode, NINODE);
+}
+
+// Add a page of IPP entries to the cache, if it may
+// still grow and memory is available.
+// Caller must hold icache.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  int i;
+
+  for(i = 0; i < NIPAGE; i++){
+    if(icache.page[i] == 0)
+      break;
   }
+  if(i == NIPAGE || (ip = kalloc_noreclaim()) == 0)
+    return 0;
+  memset(ip, 0, PGSIZE);
+  iprepare(ip, IPP);
+  icache.page[i] = ip;
+  icache.npage++;
+  icache.ngrow++;
+  return 1;
 }
 
-static struct inode* iget(uint dev, uint inum);
+// Give back to kalloc() the pages whose entries are all
+// unused, dropping the inodes they cache.  Called by
+// kalloc() when it runs out of memory; must not sleep.
+// Returns the number of pages freed.
+int
+ishrink(void)
+{
+  struct inode *ip;
+  int i, j, nfree;
+
+  nfree = 0;
+  acquire(&icache.lock);
+  icache.reclaim = 1;
+  for(i = 0; i < NIPAGE; i++){
+    if((ip = icache.page[i]) == 0)
+      continue;
+    for(j = 0; j < IPP; j++){
+      if(ip[j].ref > 0)
+        break;
+    }
+    if(j < IPP)
+      continue;
+    for(j = 0; j < IPP; j++){
+      iunlink(&ip[j]);
+      if(ip[j].inum)
+        iunhash(&ip[j]);
+    }
+    kfree(ip);
+    icache.page[i] = 0;
+    icache.npage--;
+    icache.nshrink++;
+    nfree++;
+  }
+  release(&icache.lock);
+  return nfree;
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -199,8 +607,8 @@ ialloc(uint dev, short type)
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  for(inum = 1; inum < sb[dev].ninodes; inum++){
+    bp = bread(dev, IBLOCK(inum, sb[dev]));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
@@ -224,13 +632,16 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
-  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  bp = bread(ip->dev, IBLOCK(ip->inum, sb[ip->dev]));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
+  if(ip->dpage && dip->size > ip->dstart*BSIZE)
+    dip->size = ip->dstart*BSIZE;   // the rest is not on disk yet
+  dip->flags = ip->flags;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
@@ -239,34 +650,45 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  int h;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  h = IHASH(dev, inum);
+  for(ip = icache.hash[h]; ip != 0; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        iunlink(ip);
+      icache.nhit++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
+  icache.nmiss++;
 
   // Recycle an inode cache entry.
-  if(empty == 0)
+  ip = icache.lru.prev;
+  if((ip == &icache.lru || ip->inum != 0) && igrow())
+    ip = icache.lru.prev;
+  if(ip == &icache.lru)
     panic("iget: no inodes");
+  iunlink(ip);
+  if(ip->inum != 0){
+    iunhash(ip);
+    icache.nevict++;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = icache.hash[h];
+  icache.hash[h] = ip;
   release(&icache.lock);
 
   return ip;
@@ -297,16 +719,24 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+    bp = bread(ip->dev, IBLOCK(ip->inum, sb[ip->dev]));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
+    ip->flags = dip->flags;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
+    ip->ranext = 0;
+    ip->rawin = 0;
+    ip->raend = 0;
+    ip->goal = 0;
+    ip->dpage = 0;
+    ip->dn = 0;
+    ip->pend = 0;
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -323,10 +753,12 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry goes
+// on the LRU list, to be recycled.
 // If that was the last reference and the inode has no links
-// to it, free the inode (and its content) on disk.
+// to it, free the inode (and its content) on disk; if it
+// still has links, write out any delayed data and give back
+// unused preallocated blocks.
 // All calls to iput() must be inside a transaction in
 // case it has to free the inode.
 void
@@ -334,26 +766,37 @@ iput(struct inode *ip)
 {
   acquire(&icache.lock);
 
-  if(ip->ref == 1 && ip->valid && ip->nlink == 0){
-    // inode has no links and no other references: truncate and free.
-
+  if(ip->ref == 1 && ip->valid && (ip->nlink == 0 || ip->dpage || ip->pend)){
     // ip->ref == 1 means no other process can have ip locked,
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
     release(&icache.lock);
 
-    itrunc(ip);
-    ip->type = 0;
-    iupdate(ip);
-    ip->valid = 0;
+    if(ip->nlink > 0){
+      // fileclose() has normally done the iflush() already.
+      iflush(ip);
+      iunprealloc(ip);
+    } else {
+      // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dcpurge(ip);
+      itrunc(ip);
+      ip->type = 0;
+      iupdate(ip);
+      ip->valid = 0;
+    }
 
     releasesleep(&ip->lock);
 
     acquire(&icache.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(!ip->valid)
+      iunhash(ip);   // nothing worth keeping
+    ilink(ip);
+  }
   release(&icache.lock);
 }
 
@@ -370,150 +813,905 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The NDINDIRECT after
+// those are listed in the indirect blocks listed in the
+// doubly-indirect block ip->addrs[NDIRECT+1], and the
+// NTINDIRECT after those likewise, three levels down from
+// the triply-indirect block ip->addrs[NDIRECT+2].
+//
+// An inode with I_EXTENT in ip->flags instead keeps the root
+// of an extent tree in ip->addrs[]; see struct extent in fs.h.
+
+#define EXTHDR(ip)  ((struct extenthdr*)(ip)->addrs)
+#define EXTROOT(ip) ((struct extent*)(EXTHDR(ip) + 1))
+
+// The most tree blocks one einsert() logs: a new block for
+// each level below the root, and one more, either the block on
+// the right edge that gets the new entry or, if the tree grows
+// a level, the one that takes the root's old entries.
+#define EINSBLOCKS(ip) (EXTHDR(ip)->depth + 1)
+
+// Return the index of the last of the n extents e[] that
+// starts at or before file block bn, or -1 if there is none.
+static int
+extfind(struct extent *e, int n, uint bn)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = n;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(e[mid].lblk <= bn)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo - 1;
+}
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Return the disk block address of the nth block in extent
+// inode ip, and set *run to the number of blocks from bn on
+// that are contiguous with it on disk.
+// Return 0 if there is no such block.
 static uint
-bmap(struct inode *ip, uint bn)
+emap(struct inode *ip, uint bn, uint *run)
 {
-  uint addr, *a;
+  struct extenthdr *h;
+  struct extent *e, x;
   struct buf *bp;
+  int i, depth;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
-    return addr;
-  }
-  bn -= NDIRECT;
-
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
-    }
+  h = EXTHDR(ip);
+  e = EXTROOT(ip);
+  if((i = extfind(e, h->n, bn)) < 0)
+    return 0;
+  x = e[i];
+  for(depth = h->depth; depth > 0; depth--){
+    bp = bread(ip->dev, x.pblk);
+    h = (struct extenthdr*)bp->data;
+    e = (struct extent*)(h + 1);
+    if((i = extfind(e, h->n, bn)) >= 0)
+      x = e[i];
     brelse(bp);
-    return addr;
+    if(i < 0)
+      return 0;
   }
-
-  panic("bmap: out of range");
+  if(bn - x.lblk >= x.len)
+    return 0;
+  *run = x.len - (bn - x.lblk);
+  return x.pblk + (bn - x.lblk);
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
-void
-itrunc(struct inode *ip)
+// Add the len disk blocks from addr on as file blocks bn on
+// to the *n extents e[], growing the last extent if addr and
+// bn both follow on from it.
+// Return 0 if that needs a new extent and e[] already has max.
+static int
+eadd(struct extent *e, ushort *n, int max, uint bn, uint addr, uint len)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  struct extent *last;
 
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
+  if(*n > 0){
+    last = &e[*n - 1];
+    if(bn == last->lblk + last->len && addr == last->pblk + last->len){
+      last->len += len;
+      return 1;
     }
   }
+  if(*n >= max)
+    return 0;
+  e[*n].lblk = bn;
+  e[*n].pblk = addr;
+  e[*n].len = len;
+  (*n)++;
+  return 1;
+}
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
+// Return a new block of depth depth whose subtree holds just
+// the extent bn, addr, len: a leaf, or an index block with one
+// entry for a new block one level down.
+static uint
+enew(struct inode *ip, int depth, uint bn, uint addr, uint len)
+{
+  struct extenthdr *lh;
+  struct buf *bp;
+  uint blk, child;
+
+  child = 0;
+  if(depth > 0)
+    child = enew(ip, depth-1, bn, addr, len);
+  blk = balloc(ip->dev);
+  bp = bread(ip->dev, blk);
+  lh = (struct extenthdr*)bp->data;
+  lh->depth = depth;
+  if(depth == 0)
+    eadd((struct extent*)(lh + 1), &lh->n, NEXTLEAF, bn, addr, len);
+  else
+    eadd((struct extent*)(lh + 1), &lh->n, NEXTLEAF, bn, child, 0);
+  log_write(bp);
+  brelse(bp);
+  return blk;
+}
+
+// Add the extent bn, addr, len to the *n entries e[] of a node
+// depth levels above the extents, which can hold max, on the
+// right edge of the tree: to the last extent or the subtree of
+// the last entry, or else as a new entry.
+// Return 0 if the node and the subtree are full, 1 if e[]
+// changed, or 2 if only blocks below the node did.
+static int
+eappendnode(struct inode *ip, struct extent *e, ushort *n, int max,
+            int depth, uint bn, uint addr, uint len)
+{
+  struct extenthdr *lh;
+  struct buf *bp;
+  int r;
+
+  if(depth == 0)
+    return eadd(e, n, max, bn, addr, len);
+  if(*n > 0){
+    bp = bread(ip->dev, e[*n - 1].pblk);
+    lh = (struct extenthdr*)bp->data;
+    r = eappendnode(ip, (struct extent*)(lh + 1), &lh->n, NEXTLEAF,
+                    depth-1, bn, addr, len);
+    if(r == 1)
+      log_write(bp);
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    if(r)
+      return 2;
   }
+  if(*n >= max)
+    return 0;
+  e[*n].lblk = bn;
+  e[*n].pblk = enew(ip, depth-1, bn, addr, len);
+  e[*n].len = 0;
+  (*n)++;
+  return 1;
+}
 
-  ip->size = 0;
-  iupdate(ip);
+// Map file blocks bn..bn+len-1 of extent inode ip, which must
+// lie past all of ip's mapped blocks, to the disk blocks from
+// addr on.  Logs at most EINSBLOCKS(ip) blocks of the tree.
+static void
+einsert(struct inode *ip, uint bn, uint addr, uint len)
+{
+  struct extenthdr *h, *lh;
+  struct extent *e;
+  struct buf *bp;
+  uint blk;
+
+  h = EXTHDR(ip);
+  e = EXTROOT(ip);
+  if(eappendnode(ip, e, &h->n, NEXTROOT, h->depth, bn, addr, len))
+    return;
+
+  // The root and its right edge are full: move the root's
+  // entries into a new block, and make the root an index of
+  // that one, a level higher.
+  blk = balloc(ip->dev);
+  bp = bread(ip->dev, blk);
+  lh = (struct extenthdr*)bp->data;
+  memmove(lh + 1, e, h->n * sizeof(*e));
+  lh->n = h->n;
+  lh->depth = h->depth;
+  log_write(bp);
+  brelse(bp);
+  e[0].pblk = blk;
+  e[0].len = 0;
+  h->n = 1;
+  h->depth++;
+  if(!eappendnode(ip, e, &h->n, NEXTROOT, h->depth, bn, addr, len))
+    panic("einsert");
 }
 
-// Copy stat information from inode.
-// Caller must hold ip->lock.
-void
-stati(struct inode *ip, struct stat *st)
+// Preallocation.
+// When eappend() gives a regular file a block, it reserves a
+// window of blocks in a row from there on, as many as the file
+// already has, between PREMIN and PREMAX, so that a file that
+// grows a block at a time, while others do too, still gets
+// contiguous blocks.  The window's unused blocks are given
+// back by iunprealloc() when the file's last reference goes
+// away.  fallocate() reserves blocks the same way (see
+// iprealloc()), but for good.  Blocks past the end of a file
+// are never read, so neither kind is zeroed.
+#define PREMIN 8
+#define PREMAX 64
+
+// Allocate a disk block for file block bn of extent inode ip,
+// which must lie past all of ip's mapped blocks, preferring the
+// disk block after bn-1's so that the last extent just grows.
+static uint
+eappend(struct inode *ip, uint bn)
 {
-  st->dev = ip->dev;
-  st->ino = ip->inum;
-  st->type = ip->type;
-  st->nlink = ip->nlink;
-  st->size = ip->size;
+  uint addr, goal, run, n;
+
+  goal = 0;
+  if(bn > 0 && (goal = emap(ip, bn-1, &run)) != 0)
+    goal++;
+
+  n = 1;
+  if(ip->type == T_FILE){
+    n = bn < PREMIN ? PREMIN : (bn > PREMAX ? PREMAX : bn);
+    for(; n > 1; n /= 2){
+      if((addr = balloc_run(ip->dev, goal ? goal : ip->goal, n)) != 0)
+        break;
+    }
+  }
+  if(n <= 1){
+    n = 1;
+    addr = balloc_inode(ip, goal);
+  }
+  einsert(ip, bn, addr, n);
+  ip->goal = addr + n;
+  if(n > 1){
+    __sync_fetch_and_add(&fsstat.nprealloc, 1);
+    if(ip->pend == 0)
+      ip->pstart = bn;
+    ip->pend = bn + n;
+  }
+  return addr;
 }
 
-// Read data from inode.
-// Caller must hold ip->lock.
-// If user_dst==1, then dst is a user virtual address;
-// otherwise, dst is a kernel address.
-int
-readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+// Return the file block after the last one extent inode ip
+// has mapped.
+static uint
+elast(struct inode *ip)
 {
-  uint tot, m;
+  struct extenthdr *h;
+  struct extent *e, x;
   struct buf *bp;
+  int depth;
 
-  if(off > ip->size || off + n < off)
+  h = EXTHDR(ip);
+  e = EXTROOT(ip);
+  if(h->n == 0)
     return 0;
-  if(off + n > ip->size)
-    n = ip->size - off;
+  x = e[h->n - 1];
+  for(depth = h->depth; depth > 0; depth--){
+    bp = bread(ip->dev, x.pblk);
+    h = (struct extenthdr*)bp->data;
+    e = (struct extent*)(h + 1);
+    x = e[h->n - 1];
+    brelse(bp);
+  }
+  return x.lblk + x.len;
+}
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
+// Free the blocks that extents e[0..*n-1] map from file block
+// bn on, dropping the extents left empty.
+// Return 1 if that changed e[], else 0.
+static int
+etrimext(uint dev, struct extent *e, ushort *n, uint bn)
+{
+  struct extent *x;
+  int changed;
+
+  changed = 0;
+  while(*n > 0){
+    x = &e[*n - 1];
+    if(x->lblk + x->len <= bn)
       break;
+    changed = 1;
+    if(x->lblk >= bn){
+      bfreerun(dev, x->pblk, x->len);
+      (*n)--;
+      continue;
     }
-    brelse(bp);
+    bfreerun(dev, x->pblk + (bn - x->lblk), x->lblk + x->len - bn);
+    x->len = bn - x->lblk;
+    break;
   }
-  return tot;
+  return changed;
 }
 
-// Write data to inode.
-// Caller must hold ip->lock.
-// If user_src==1, then src is a user virtual address;
-// otherwise, src is a kernel address.
-int
-writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+// Like etrimext(), for the entries e[0..*n-1] of a node depth
+// levels above the extents, also freeing the blocks of the
+// tree that are left empty.
+static int
+etrimnode(uint dev, struct extent *e, ushort *n, int depth, uint bn)
 {
-  uint tot, m;
+  struct extenthdr *lh;
   struct buf *bp;
-
-  if(off > ip->size || off + n < off)
-    return -1;
-  if(off + n > MAXFILE*BSIZE)
-    return -1;
-
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+  int changed;
+
+  if(depth == 0)
+    return etrimext(dev, e, n, bn);
+  changed = 0;
+  while(*n > 0){
+    bp = bread(dev, e[*n - 1].pblk);
+    lh = (struct extenthdr*)bp->data;
+    if(etrimnode(dev, (struct extent*)(lh + 1), &lh->n, depth-1, bn) == 0){
+      brelse(bp);
+      break;
+    }
+    if(lh->n > 0){
+      log_write(bp);
       brelse(bp);
       break;
     }
-    log_write(bp);
     brelse(bp);
+    bfree(dev, e[*n - 1].pblk);   // block is empty
+    (*n)--;
+    changed = 1;
   }
+  return changed;
+}
 
-  if(n > 0){
-    if(off > ip->size)
-      ip->size = off;
-    // write the i-node back to disk even if the size didn't change
-    // because the loop above might have called bmap() and added a new
-    // block to ip->addrs[].
-    iupdate(ip);
-  }
+// Free the blocks of extent inode ip from file block bn on.
+static void
+etrim(struct inode *ip, uint bn)
+{
+  struct extenthdr *h;
 
-  return n;
+  h = EXTHDR(ip);
+  etrimnode(ip->dev, EXTROOT(ip), &h->n, h->depth, bn);
+  if(h->n == 0)
+    h->depth = 0;
 }
 
-// Directories
+// Give file blocks bn..bn+n-1 of regular extent inode ip disk
+// blocks, in runs each as long as free space allows, without
+// changing ip->size, logging at most nblocks blocks.  Each run
+// logs its bitmap block and at most EINSBLOCKS(ip) blocks of
+// the extent tree, each with its own bitmap block.  So that ip's mapped
+// blocks stay a prefix of the file, starts from the first
+// unmapped block if that comes before bn.  What eappend()
+// preallocated is kept from now on.
+// All or nothing: if nblocks or free space runs out first,
+// the blocks given so far are freed again.  A run leaves free
+// at least the blocks the tree may still need.
+// Returns 0, or -1 if it could not give them all.
+// Caller must hold ip->lock and be in a transaction.
+int
+iprealloc(struct inode *ip, uint bn, uint n, int nblocks)
+{
+  uint end, run, goal, addr, len, first, avail;
+
+  if(ip->type != T_FILE || !(ip->flags & I_EXTENT))
+    return -1;
+  end = bn + n;
+  ip->pend = 0;
+  if((first = bn = elast(ip)) >= end)
+    return 0;
+  while(bn < end && (nblocks -= 1 + 2*EINSBLOCKS(ip)) >= 0){
+    if((avail = bavail(ip->dev)) <= EINSBLOCKS(ip))
+      break;
+    goal = ip->goal;
+    if(bn > 0 && (goal = emap(ip, bn-1, &run)) != 0)
+      goal++;
+    len = min(min(end - bn, BPB), avail - EINSBLOCKS(ip));
+    while((addr = balloc_run(ip->dev, goal, len)) == 0 && len > 1)
+      len /= 2;
+    if(addr == 0)
+      break;
+    einsert(ip, bn, addr, len);
+    ip->goal = addr + len;
+    bn += len;
+  }
+  if(bn < end && bn > first)
+    etrim(ip, first);
+  iupdate(ip);
+  return bn < end ? -1 : 0;
+}
+
+// Give back the blocks of ip's preallocation window that are
+// past its end, unless they hold delayed data.
+// Caller must hold ip->lock and be in a transaction.
+static void
+iunprealloc(struct inode *ip)
+{
+  uint bn;
+
+  if(ip->pend == 0)
+    return;
+  bn = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->dpage)
+    bn = ip->dstart + ip->dn;
+  if(bn < ip->pstart)
+    bn = ip->pstart;
+  if(bn < ip->pend){
+    __sync_fetch_and_add(&fsstat.nprefree, ip->pend - bn);
+    etrim(ip, bn);
+    iupdate(ip);
+  }
+  ip->pend = 0;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, allocate one if alloc is set, and
+// otherwise return 0.
+static uint
+bwalk(struct inode *ip, uint bn, int alloc)
+{
+  uint addr, *a, span, i;
+  int level;
+  struct buf *bp;
+
+  if(ip->flags & I_EXTENT){
+    if((addr = emap(ip, bn, &span)) == 0 && alloc)
+      addr = eappend(ip, bn);
+    return addr;
+  }
+
+  if(bn < NDIRECT){
+    if((addr = ip->addrs[bn]) == 0 && alloc)
+      ip->addrs[bn] = addr = balloc_inode(ip, 0);
+    return addr;
+  }
+  bn -= NDIRECT;
+
+  // Find how many levels of indirect blocks lead to bn,
+  // and how many blocks each entry of the top one spans.
+  span = 1;
+  for(level = 1; level <= 3; level++){
+    if(bn < span*NINDIRECT)
+      break;
+    bn -= span*NINDIRECT;
+    span *= NINDIRECT;
+  }
+  if(level > 3)
+    panic("bmap: out of range");
+
+  // Load indirect blocks, allocating if necessary.
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0){
+    if(!alloc)
+      return 0;
+    ip->addrs[NDIRECT+level-1] = addr = balloc_inode(ip, 0);
+  }
+  for(; span > 0; span /= NINDIRECT){
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    i = bn / span;
+    bn %= span;
+    if((addr = a[i]) == 0 && alloc){
+      a[i] = addr = balloc_inode(ip, 0);
+      log_write(bp);
+    }
+    brelse(bp);
+    if(addr == 0)
+      return 0;
+  }
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bwalk(ip, bn, 1);
+}
+
+// Like bmap, but return 0 rather than allocate a block that
+// is not there, for a caller that is not in a transaction.
+// Set *run as bmaprun() does.
+static uint
+bmapget(struct inode *ip, uint bn, uint *run)
+{
+  *run = 1;
+  if(ip->flags & I_EXTENT)
+    return emap(ip, bn, run);
+  return bwalk(ip, bn, 0);
+}
+
+// Like bmap, but also set *run to the number of blocks from
+// bn on that are contiguous with it on disk, so that readi()
+// and writei() need only one lookup for a run of blocks.
+static uint
+bmaprun(struct inode *ip, uint bn, uint *run)
+{
+  uint addr;
+
+  __sync_fetch_and_add(&fsstat.nlookup, 1);
+  *run = 1;
+  if((ip->flags & I_EXTENT) && (addr = emap(ip, bn, run)) != 0)
+    return addr;
+  return bmap(ip, bn);
+}
+
+// Free the indirect block addr, level levels above the
+// data blocks, and all the blocks under it.
+static void
+itruncind(uint dev, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  if(level > 0){
+    bp = bread(dev, addr);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j])
+        itruncind(dev, a[j], level-1);
+    }
+    brelse(bp);
+  }
+  bfree(dev, addr);
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock.
+void
+itrunc(struct inode *ip)
+{
+  int i;
+
+  if(ip->dpage){
+    kfree(ip->dpage);
+    ip->dpage = 0;
+    ip->dn = 0;
+  }
+  ip->pend = 0;
+
+  if(ip->flags & I_EXTENT){
+    etrim(ip, 0);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+
+  for(i = 0; i < NDIRECT; i++){
+    if(ip->addrs[i]){
+      bfree(ip->dev, ip->addrs[i]);
+      ip->addrs[i] = 0;
+    }
+  }
+
+  for(i = 0; i < 3; i++){
+    if(ip->addrs[NDIRECT+i]){
+      itruncind(ip->dev, ip->addrs[NDIRECT+i], i+1);
+      ip->addrs[NDIRECT+i] = 0;
+    }
+  }
+
+  ip->size = 0;
+  iupdate(ip);
+}
+
+// Copy stat information from inode.
+// Caller must hold ip->lock.
+void
+stati(struct inode *ip, struct stat *st)
+{
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+}
+
+// Sequential read-ahead.
+// readi() tells readahead() about each block it reads.
+// While a file is read sequentially, readahead() keeps up to
+// ip->rawin blocks past the current one being read into the
+// buffer cache with breadahead().  The window starts at RAMIN
+// blocks, and doubles, up to RAMAX, each time the reader has
+// used up half of it.  A non-sequential read closes the window.
+#define RAMIN 4
+#define RAMAX 64
+
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint end, nblock, addr, len, run;
+
+  if(bn + 1 == ip->ranext)
+    return;            // still in the same block
+  if(bn != ip->ranext){
+    ip->ranext = bn + 1;
+    ip->rawin = 0;
+    return;
+  }
+  ip->ranext = bn + 1;
+
+  if(ip->rawin == 0){
+    ip->rawin = RAMIN;
+    ip->raend = bn + 1;
+  } else if(ip->raend > bn + 1 + ip->rawin/2){
+    return;            // enough is already on the way
+  } else if(ip->rawin < RAMAX){
+    ip->rawin *= 2;
+  }
+  if(ip->raend < bn + 1)
+    ip->raend = bn + 1;
+
+  nblock = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->dpage)
+    nblock = ip->dstart;   // the rest has no disk blocks yet
+  end = min(bn + 1 + ip->rawin, nblock);
+
+  // Start each run of blocks that are next to each other on
+  // disk with one breadaheadv().
+  // Holes have nothing to read; readahead() is not in a
+  // transaction, so it must not give them blocks.
+  while(ip->raend < end){
+    if((addr = bmapget(ip, ip->raend, &run)) == 0){
+      ip->raend++;
+      continue;
+    }
+    len = min(run, end - ip->raend);
+    while(ip->raend + len < end && bmapget(ip, ip->raend + len, &run) == addr + len)
+      len += min(run, end - ip->raend - len);
+    breadaheadv(ip->dev, addr, len);
+    ip->raend += len;
+  }
+}
+
+#define RBATCH 16   // blocks readi() reads at once, at most
+
+// Read data from inode.
+// Caller must hold ip->lock.
+// If user_dst==1, then dst is a user virtual address;
+// otherwise, dst is a kernel address.
+int
+readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m, bn, rbn, rpbn, rlen, k;
+  struct buf *bs[RBATCH];
+  int i, nb, nok, ok;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  // Blocks rbn..rbn+rlen-1 are at disk blocks rpbn...
+  rbn = rpbn = rlen = 0;
+  ok = 1;
+  for(tot=0; ok && tot<n; ){
+    bn = off/BSIZE;
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->dpage && bn >= ip->dstart){
+      // written, but not yet on disk
+      if(either_copyout(user_dst, dst, ip->dpage + (bn - ip->dstart)*BSIZE + off%BSIZE, m) == -1)
+        break;
+      tot += m;
+      off += m;
+      dst += m;
+      continue;
+    }
+    if(bn - rbn >= rlen){
+      rbn = bn;
+      rpbn = bmaprun(ip, bn, &rlen);
+    }
+
+    // Get the blocks of the run that this read still needs,
+    // up to RBATCH, with the disk reading those that are not
+    // cached together.
+    k = min(rlen - (bn - rbn), (off%BSIZE + n - tot + BSIZE - 1) / BSIZE);
+    if(ip->dpage)
+      k = min(k, ip->dstart - bn);
+    k = min(k, RBATCH);
+    nb = bread_asyncv(ip->dev, rpbn + (bn - rbn), k, bs);
+    nok = 0;
+    for(i = 0; i < nb; i++){
+      bwait(bs[i]);
+      if(ok){
+        __sync_fetch_and_add(&fsstat.nblock, 1);
+        m = min(n - tot, BSIZE - off%BSIZE);
+        if(either_copyout(user_dst, dst, bs[i]->data + (off % BSIZE), m) == -1){
+          ok = 0;
+        } else {
+          tot += m;
+          off += m;
+          dst += m;
+          nok++;
+        }
+      }
+      brelse(bs[i]);
+    }
+    for(i = 0; i < nok; i++)
+      readahead(ip, bn + i);
+  }
+  return tot;
+}
+
+// Delayed allocation.
+// A block appended to a regular file is not given a disk block
+// straight away: writei() leaves it in ip->dpage, a page that
+// holds up to DBLOCKS blocks from file block ip->dstart on, and
+// readi() reads it from there.  iflush() allocates disk blocks
+// for the whole page at once, so they are next to each other on
+// disk, and writes it.  That happens when the page is full or
+// more than DTICKS old and the file grows past it, and on
+// fsync() and close() (see fileflush()).  A file that stops
+// growing but stays open is flushed by iflushd() once its page
+// is DTICKS old, or when memory runs short.  A small append thus
+// costs one copy rather than a block write, and a run of them
+// is written once.  On disk the inode's size stops at
+// ip->dstart until then.
+#define DBLOCKS (PGSIZE / BSIZE)
+#define DTICKS  30
+
+// Allocate disk blocks for the blocks in ip->dpage and write
+// them.
+// Caller must hold ip->lock and be in a transaction.
+void
+iflush(struct inode *ip)
+{
+  struct buf *bp;
+  uint i, addr;
+
+  if(ip->dpage == 0)
+    return;
+  __sync_fetch_and_add(&fsstat.nflush, 1);
+  for(i = 0; i < ip->dn; i++){
+    addr = bmap(ip, ip->dstart + i);
+    bp = bread(ip->dev, addr);
+    memmove(bp->data, ip->dpage + i*BSIZE, BSIZE);
+    log_data(bp);
+    brelse(bp);
+  }
+  kfree(ip->dpage);
+  ip->dpage = 0;
+  ip->dn = 0;
+  iupdate(ip);
+}
+
+// Return the next cached inode from *k on with delayed data,
+// all of it if all is set or else only that more than DTICKS
+// old, with a new reference, and advance *k past it; or 0.
+static struct inode*
+idirty(int *k, int all)
+{
+  struct inode *ip, *found;
+  int i;
+
+  found = 0;
+  acquire(&icache.lock);
+  for(; found == 0 && *k < NINODE + NIPAGE*IPP; (*k)++){
+    i = *k - NINODE;
+    if(i < 0)
+      ip = &icache.inode[*k];
+    else if(icache.page[i/IPP])
+      ip = &icache.page[i/IPP][i%IPP];
+    else
+      continue;
+    if(ip->ref > 0 && ip->dpage && (all || ticks - ip->dtime >= DTICKS)){
+      ip->ref++;
+      found = ip;
+    }
+  }
+  release(&icache.lock);
+  return found;
+}
+
+// The flusher, a kernel process that main() starts.  Every
+// DTICKS/2 ticks it flushes delayed data more than DTICKS old,
+// and once kalloc() has run short of memory (see ishrink()),
+// all of it, so that kfree() gets the pages back.
+void
+iflushd(void)
+{
+  struct inode *ip;
+  uint last;
+  int k, all;
+
+  // Still holding p->lock from scheduler(), as in forkret().
+  release(&myproc()->lock);
+
+  last = ticks;
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+    all = __sync_lock_test_and_set(&icache.reclaim, 0);
+    if(!all && ticks - last < DTICKS/2)
+      continue;
+    last = ticks;
+    for(k = 0; (ip = idirty(&k, all)) != 0; ){
+      begin_op();
+      ilock(ip);
+      if(ip->dpage && (all || ticks - ip->dtime >= DTICKS)){
+        __sync_fetch_and_add(&fsstat.nsweep, 1);
+        iflush(ip);
+      }
+      iunlock(ip);
+      iput(ip);
+      end_op();
+    }
+  }
+}
+
+// Return where in ip->dpage writei() should put file block
+// bn, or 0 if it should write bn to disk.
+// Caller must hold ip->lock and be in a transaction.
+static char*
+idelay(struct inode *ip, uint bn)
+{
+  if(ip->dpage){
+    if(bn >= ip->dstart && bn < ip->dstart + ip->dn)
+      return ip->dpage + (bn - ip->dstart)*BSIZE;
+    if(bn != ip->dstart + ip->dn)
+      return 0;
+    if(ip->dn < DBLOCKS && ticks - ip->dtime < DTICKS)
+      goto add;
+    iflush(ip);   // full or old; start a new page
+  }
+
+  // Only a block that is new at the end of a file qualifies,
+  // whether or not it has been preallocated.
+  if(ip->type != T_FILE || !(ip->flags & I_EXTENT))
+    return 0;
+  if(ip->size % BSIZE != 0 || bn != ip->size / BSIZE)
+    return 0;
+  if((ip->dpage = kalloc()) == 0)
+    return 0;     // short of memory; write it now
+  ip->dstart = bn;
+  ip->dn = 0;
+  ip->dtime = ticks;
+
+add:
+  __sync_fetch_and_add(&fsstat.ndelay, 1);
+  memset(ip->dpage + ip->dn*BSIZE, 0, BSIZE);
+  return ip->dpage + ip->dn++ * BSIZE;
+}
+
+// Write data to inode.
+// Caller must hold ip->lock.
+// If user_src==1, then src is a user virtual address;
+// otherwise, src is a kernel address.
+int
+writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m, bn, rbn, rpbn, rlen;
+  struct buf *bp;
+  char *p;
+  int direct;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
+    return -1;
+
+  // Blocks rbn..rbn+rlen-1 are at disk blocks rpbn...
+  rbn = rpbn = rlen = 0;
+  direct = 0;
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    bn = off/BSIZE;
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if((p = idelay(ip, bn)) != 0){
+      if(either_copyin(p + off%BSIZE, user_src, src, m) == -1)
+        break;
+      continue;
+    }
+    if(bn - rbn >= rlen){
+      rbn = bn;
+      rpbn = bmaprun(ip, bn, &rlen);
+    }
+    __sync_fetch_and_add(&fsstat.nblock, 1);
+    bp = bread(ip->dev, rpbn + (bn - rbn));
+    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      brelse(bp);
+      break;
+    }
+    if(ip->type == T_FILE)
+      log_data(bp);   // ordered, not logged; see log.c
+    else
+      log_write(bp);
+    brelse(bp);
+    direct = 1;
+  }
+
+  if(n > 0){
+    if(off > ip->size)
+      ip->size = off;
+    // write the i-node back to disk even if the size didn't change
+    // because the loop above might have called bmap() and added a new
+    // block to ip->addrs[].  Blocks left in ip->dpage change
+    // neither.
+    if(direct || ip->dpage == 0)
+      iupdate(ip);
+  }
+
+  return tot;
+}
+
+// Directories
 
 int
 namecmp(const char *s, const char *t)
@@ -521,32 +1719,538 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory entry cache.
+//
+// The dcache remembers what dirlookup() found: for a name in a
+// directory, the inode number and offset of its entry, or, as a
+// negative entry with inum 0, that there is no such entry.  Each
+// (dev, directory, name) hashes to a set of DCWAYS entries, in
+// which a new entry replaces the least recently used.  Callers
+// of dirlookup(), dirlink() and dirunlink() hold the directory's
+// lock, so its entries cannot change under them; dirlink() and
+// dirunlink() keep the cache current, and iput() drops a
+// directory's entries when it frees the directory.
+#define DCSETS 128
+#define DCWAYS 4
+
+struct dentry {
+  uint dev;
+  uint dir;       // directory's inum; 0 if the entry is unused
+  uint inum;      // 0 if name is not in dir
+  uint off;       // byte offset of name's dirent in dir
+  uint lastuse;
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry set[DCSETS][DCWAYS];
+  uint clock;     // source of lastuse timestamps.
+
+  // statistics.
+  uint nhit;
+  uint nneg;      // hits on negative entries
+  uint nmiss;
+} dcache;
+
+static void
+dcinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+// Return the set that (dev, dir, name) hashes to, by FNV-1a.
+static struct dentry*
+dcset(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  h = (h ^ dev) * 16777619U;
+  h = (h ^ dir) * 16777619U;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  return dcache.set[h % DCSETS];
+}
+
+// Find name's entry in directory dp's set.
+// Caller must hold dcache.lock.
+static struct dentry*
+dcfind(struct dentry *set, struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = set; d < set+DCWAYS; d++){
+    if(d->dir == dp->inum && d->dev == dp->dev && namecmp(name, d->name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Look name up in the dcache.  If it is there, set *inum and
+// *off from its entry, and return 1.  Caller must hold dp->lock.
+static int
+dcget(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dcset(dp->dev, dp->inum, name), dp, name)) == 0){
+    dcache.nmiss++;
+    release(&dcache.lock);
+    return 0;
+  }
+  d->lastuse = dcache.clock++;
+  *inum = d->inum;
+  *off = d->off;
+  if(d->inum)
+    dcache.nhit++;
+  else
+    dcache.nneg++;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name is in directory dp at inum and off,
+// or, if inum is 0, that it is not.  Caller must hold dp->lock.
+static void
+dcput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *set, *d, *v;
+
+  acquire(&dcache.lock);
+  set = dcset(dp->dev, dp->inum, name);
+  if((d = dcfind(set, dp, name)) == 0){
+    // Take an unused entry, or else the least recently used.
+    d = set;
+    for(v = set; v < set+DCWAYS; v++){
+      if(v->dir == 0){
+        d = v;
+        break;
+      }
+      if(v->lastuse - d->lastuse > (1U<<31))
+        d = v;
+    }
+  }
+  d->dev = dp->dev;
+  d->dir = dp->inum;
+  d->inum = inum;
+  d->off = off;
+  d->lastuse = dcache.clock++;
+  strncpy(d->name, name, DIRSIZ);
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dp, which is being freed.
+static void
+dcpurge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = &dcache.set[0][0]; d < &dcache.set[DCSETS][0]; d++){
+    if(d->dir == dp->inum && d->dev == dp->dev)
+      d->dir = 0;
+  }
+  release(&dcache.lock);
+}
+
+// Indexed directories; see struct dxroot in fs.h.
+
+// Hash a directory entry name: FNV-1a over at most DIRSIZ
+// characters.  mkfs computes the same hash.
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  return h;
+}
+
+// Return the index of the entry of e[0..n-1], which are
+// sorted by hash, for the leaf or node that holds names with
+// hash h.
+static int
+dxfind(struct dxentry *e, int n, uint h)
+{
+  int lo, hi, mid;
+
+  lo = 1;
+  hi = n;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(e[mid].hash <= h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo - 1;
+}
+
+// Return the block within indexed directory dp of the leaf
+// for names with hash h.  Set *i to the index of the root
+// entry on the way, and *j to that of the node entry, or -1
+// if the root lists leaves.
+static uint
+dxleaf(struct inode *dp, uint h, int *i, int *j)
+{
+  struct buf *bp;
+  struct dxroot *r;
+  struct dxnode *x;
+  uint bn;
+  int depth;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  *i = dxfind(r->e, r->n, h);
+  bn = r->e[*i].block;
+  depth = r->depth;
+  brelse(bp);
+  *j = -1;
+  if(depth == 0)
+    return bn;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  x = (struct dxnode*)bp->data;
+  *j = dxfind(x->e, x->n, h);
+  bn = x->e[*j].block;
+  brelse(bp);
+  return bn;
+}
+
+// Insert entry (hash, block) at e[at], of *n in use.
+static void
+dxinsert(struct dxentry *e, ushort *n, int at, uint hash, uint block)
+{
+  memmove(&e[at+1], &e[at], (*n - at) * sizeof(e[0]));
+  e[at].hash = hash;
+  e[at].block = block;
+  (*n)++;
+}
+
+// Add a zeroed block to the end of directory dp and return
+// its block number within dp.
+static uint
+dxgrow(struct inode *dp)
+{
+  uint bn;
+
+  bn = dp->size / BSIZE;
+  bmap(dp, bn);
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bn;
+}
+
+// Turn dp, a directory of one full block, into an indexed
+// directory whose one leaf holds all its entries but "." and
+// "..".  Returns -1, leaving dp as it was, if the block does
+// not start with "." and "..".
+static int
+dxconvert(struct inode *dp)
+{
+  struct buf *bp, *lbp;
+  struct dxroot *r;
+  uint leaf;
+  int ok;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  ok = namecmp(r->dot.name, ".") == 0 && namecmp(r->dotdot.name, "..") == 0;
+  brelse(bp);
+  if(!ok)
+    return -1;
+
+  leaf = bmap(dp, 1);
+  bp = bread(dp->dev, bmap(dp, 0));
+  lbp = bread(dp->dev, leaf);
+  memmove(lbp->data + 2*sizeof(struct dirent), bp->data + 2*sizeof(struct dirent),
+          BSIZE - 2*sizeof(struct dirent));
+  memset(bp->data + 2*sizeof(struct dirent), 0, BSIZE - 2*sizeof(struct dirent));
+  r = (struct dxroot*)bp->data;
+  r->n = 1;
+  r->e[0].hash = 0;
+  r->e[0].block = 1;
+  log_write(lbp);
+  log_write(bp);
+  brelse(lbp);
+  brelse(bp);
+
+  dp->size = 2*BSIZE;
+  dp->flags |= I_INDEX;
+  iupdate(dp);
+  dcpurge(dp);   // entries moved
+  return 0;
+}
+
+// Make room in indexed directory dp's index for the split of
+// the leaf at root entry i and node entry j (see dxleaf()):
+// move a full root's entries to a new node, or split a full
+// node in two.  Returns 1 if it changed the index, 0 if there
+// was room already, and -1 if both the root and the node are
+// full.
+static int
+dxroom(struct inode *dp, int i, int j)
+{
+  struct buf *bp, *xbp, *nbp;
+  struct dxroot *r;
+  struct dxnode *x, *nx;
+  uint bn, nbn, half;
+  int depth, n;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  depth = r->depth;
+  n = r->n;
+  bn = r->e[i].block;
+  brelse(bp);
+
+  if(depth == 0){
+    if(n < NDXENTRY)
+      return 0;
+    nbn = dxgrow(dp);
+    bp = bread(dp->dev, bmap(dp, 0));
+    nbp = bread(dp->dev, bmap(dp, nbn));
+    r = (struct dxroot*)bp->data;
+    nx = (struct dxnode*)nbp->data;
+    memmove(nx->e, r->e, r->n * sizeof(r->e[0]));
+    nx->n = r->n;
+    memset(r->e, 0, sizeof(r->e));
+    r->e[0].block = nbn;
+    r->n = 1;
+    r->depth = 1;
+    log_write(nbp);
+    log_write(bp);
+    brelse(nbp);
+    brelse(bp);
+    return 1;
+  }
+
+  xbp = bread(dp->dev, bmap(dp, bn));
+  x = (struct dxnode*)xbp->data;
+  n = x->n;
+  brelse(xbp);
+  if(n < NDXNODE)
+    return 0;
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  n = r->n;
+  brelse(bp);
+  if(n >= NDXENTRY)
+    return -1;
+
+  // Move the upper half of the node's entries to a new one.
+  nbn = dxgrow(dp);
+  xbp = bread(dp->dev, bmap(dp, bn));
+  nbp = bread(dp->dev, bmap(dp, nbn));
+  x = (struct dxnode*)xbp->data;
+  nx = (struct dxnode*)nbp->data;
+  nx->n = x->n - x->n/2;
+  memmove(nx->e, &x->e[x->n/2], nx->n * sizeof(x->e[0]));
+  memset(&x->e[x->n/2], 0, nx->n * sizeof(x->e[0]));
+  x->n /= 2;
+  half = nx->e[0].hash;
+  log_write(nbp);
+  log_write(xbp);
+  brelse(nbp);
+  brelse(xbp);
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  dxinsert(r->e, &r->n, i+1, half, nbn);
+  log_write(bp);
+  brelse(bp);
+  return 1;
+}
+
+// Split leaf bn of indexed directory dp, which is full and at
+// root entry i and node entry j, moving the names in the upper
+// half of its hashes to a new leaf.  Returns 1 if it changed
+// only the index, to make room, and the caller should look
+// again; 0 if it split the leaf; and -1 if the index is full,
+// or if all of the leaf's names have the same hash.
+static int
+dxsplit(struct inode *dp, uint bn, int i, int j)
+{
+  struct buf *bp, *nbp;
+  struct dxroot *r;
+  struct dxnode *x;
+  struct dirent *de, *nde;
+  uint s[DPB], t, split, nbn;
+  int k, m, rc;
+
+  // Find the median hash, by insertion sort.
+  bp = bread(dp->dev, bmap(dp, bn));
+  de = (struct dirent*)bp->data;
+  for(m = 0; m < DPB; m++){
+    t = dirhash(de[m].name);
+    for(k = m; k > 0 && s[k-1] > t; k--)
+      s[k] = s[k-1];
+    s[k] = t;
+  }
+  brelse(bp);
+  split = s[DPB/2];
+  if(split == s[0]){
+    for(m = 1; m < DPB && s[m] == s[0]; m++)
+      ;
+    if(m == DPB)
+      return -1;
+    split = s[m];
+  }
+
+  if((rc = dxroom(dp, i, j)) != 0)
+    return rc;
+
+  nbn = dxgrow(dp);
+  bp = bread(dp->dev, bmap(dp, bn));
+  nbp = bread(dp->dev, bmap(dp, nbn));
+  de = (struct dirent*)bp->data;
+  nde = (struct dirent*)nbp->data;
+  for(m = k = 0; m < DPB; m++){
+    if(dirhash(de[m].name) >= split){
+      nde[k++] = de[m];
+      memset(&de[m], 0, sizeof(de[m]));
+    }
+  }
+  log_write(nbp);
+  log_write(bp);
+  brelse(nbp);
+  brelse(bp);
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  if(j < 0){
+    dxinsert(r->e, &r->n, i+1, split, nbn);
+    log_write(bp);
+    brelse(bp);
+  } else {
+    bn = r->e[i].block;
+    brelse(bp);
+    bp = bread(dp->dev, bmap(dp, bn));
+    x = (struct dxnode*)bp->data;
+    dxinsert(x->e, &x->n, j+1, split, nbn);
+    log_write(bp);
+    brelse(bp);
+  }
+
+  dcpurge(dp);   // entries moved
+  return 0;
+}
+
+// Write a new directory entry (name, inum) into indexed
+// directory dp, splitting its leaf if that is full.
+// If the leaf cannot be split, dp stops being indexed, and
+// dxlink() returns -1 for dirlink() to add the entry to the
+// plain array of dirents that dp then is.
+static int
+dxlink(struct inode *dp, char *name, uint inum)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint h, bn;
+  int i, j, k;
+
+  h = dirhash(name);
+  for(;;){
+    bn = dxleaf(dp, h, &i, &j);
+    bp = bread(dp->dev, bmap(dp, bn));
+    de = (struct dirent*)bp->data;
+    for(k = 0; k < DPB; k++){
+      if(de[k].inum == 0){
+        strncpy(de[k].name, name, DIRSIZ);
+        de[k].inum = inum;
+        log_write(bp);
+        brelse(bp);
+        dcput(dp, name, inum, bn*BSIZE + k*sizeof(*de));
+        return 0;
+      }
+    }
+    brelse(bp);
+    if(dxsplit(dp, bn, i, j) < 0){
+      dp->flags &= ~I_INDEX;
+      iupdate(dp);
+      return -1;
+    }
+  }
+}
+
+// Look for name in directory dp, without the dcache.
+// If found, set *poff to the byte offset of its entry
+// and return its inum; otherwise return 0.
+static uint
+dirscan(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dxroot *r;
+  struct dirent *de, d;
+  uint off, bn, inum;
+  int i, j;
+
+  if((dp->flags & I_INDEX) == 0){
+    for(off = 0; off < dp->size; off += sizeof(d)){
+      if(readi(dp, 0, (uint64)&d, off, sizeof(d)) != sizeof(d))
+        panic("dirlookup read");
+      if(d.inum != 0 && namecmp(name, d.name) == 0){
+        // entry matches path element
+        *poff = off;
+        return d.inum;
+      }
+    }
+    return 0;
+  }
+
+  inum = 0;
+  bp = bread(dp->dev, bmap(dp, 0));
+  r = (struct dxroot*)bp->data;
+  if(namecmp(name, r->dot.name) == 0){
+    *poff = 0;
+    inum = r->dot.inum;
+  } else if(namecmp(name, r->dotdot.name) == 0){
+    *poff = sizeof(struct dirent);
+    inum = r->dotdot.inum;
+  }
+  brelse(bp);
+  if(inum)
+    return inum;
+  bn = dxleaf(dp, dirhash(name), &i, &j);
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < DPB; i++){
+    if(de[i].inum != 0 && namecmp(name, de[i].name) == 0){
+      *poff = bn*BSIZE + i*sizeof(*de);
+      inum = de[i].inum;
+      break;
+    }
+  }
+  brelse(bp);
+  return inum;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
-  struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  if(!dcget(dp, name, &inum, &off)){
+    inum = dirscan(dp, name, &off);
+    dcput(dp, name, inum, inum ? off : 0);
   }
-
-  return 0;
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -563,6 +2267,9 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if((dp->flags & I_INDEX) && dxlink(dp, name, inum) == 0)
+    return 0;
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -571,14 +2278,32 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // Rather than grow past one block, become indexed.
+  if(off == BSIZE && dp->size == BSIZE && dxconvert(dp) == 0)
+    return dxlink(dp, name, inum);
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcput(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, at byte offset off, from the
+// directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  dcput(dp, name, 0, 0);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -618,9 +2343,109 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Mount points.
+
+// Mount device dev's file system on directory ip, whose
+// reference the mount table keeps if it succeeds.
+// Must not be called inside a transaction, since fsinit()
+// may recover dev's log.
+int
+fsmount(int dev, struct inode *ip)
+{
+  struct superblock s;
+  int i;
+
+  if(dev <= ROOTDEV || dev >= NBDEV || bdevsw[dev].start == 0)
+    return -1;
+  if(ip->inum == ROOTINO)
+    return -1;
+  acquire(&mtab.lock);
+  for(i = 0; i < NBDEV; i++){
+    if(mtab.m[i].on == ip)
+      break;
+  }
+  if(i < NBDEV || mtab.m[dev].on != 0){
+    release(&mtab.lock);
+    return -1;
+  }
+  mtab.m[dev].on = ip;
+  release(&mtab.lock);
+
+  readsb(dev, &s);
+  if(s.magic != FSMAGIC){
+    acquire(&mtab.lock);
+    mtab.m[dev].on = 0;
+    release(&mtab.lock);
+    return -1;
+  }
+  fsinit(dev);
+
+  acquire(&mtab.lock);
+  mtab.m[dev].root = iget(dev, ROOTINO);
+  release(&mtab.lock);
+  return 0;
+}
+
+// Is ip a mount point?
+int
+mounted(struct inode *ip)
+{
+  int i, r = 0;
+
+  acquire(&mtab.lock);
+  for(i = 0; i < NBDEV; i++){
+    if(mtab.m[i].on == ip)
+      r = 1;
+  }
+  release(&mtab.lock);
+  return r;
+}
+
+// If ip is a mount point, release it and return the root of
+// the file system mounted there.  A system call that began
+// before the mount finished, and so has not joined that file
+// system's log, sees the directory underneath instead.
+static struct inode*
+mntdown(struct inode *ip)
+{
+  struct inode *root = 0;
+  int i;
+
+  acquire(&mtab.lock);
+  for(i = 0; i < NBDEV; i++){
+    if(mtab.m[i].on == ip && mtab.m[i].root != 0 &&
+       (myproc()->oplogs & (1 << i)))
+      root = mtab.m[i].root;
+  }
+  release(&mtab.lock);
+  if(root == 0)
+    return ip;
+  iput(ip);
+  return idup(root);
+}
+
+// If ip is the root of a mounted file system, release it and
+// return the directory it covers, whose ".." is ip's.
+static struct inode*
+mntup(struct inode *ip)
+{
+  struct inode *on = 0;
+
+  if(ip->inum != ROOTINO || ip->dev == ROOTDEV || ip->dev >= NBDEV)
+    return ip;
+  acquire(&mtab.lock);
+  on = mtab.m[ip->dev].on;
+  release(&mtab.lock);
+  if(on == 0)
+    return ip;
+  iput(ip);
+  return idup(on);
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// Crosses mount points in both directions.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
 namex(char *path, int nameiparent, char *name)
@@ -633,6 +2458,8 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    if(namecmp(name, "..") == 0)
+      ip = mntup(ip);
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -648,7 +2475,7 @@ namex(char *path, int nameiparent, char *name)
       return 0;
     }
     iunlockput(ip);
-    ip = next;
+    ip = mntdown(next);
   }
   if(nameiparent){
     iput(ip);
@@ -669,3 +2496,27 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
+
+int
+statsfs(char *buf, int sz)
+{
+  uint n;
+
+  n = fsstat.nballoc;
+  return snprintf(buf, sz,
+                  "icache: inodes %d max %d grow %d shrink %d\n"
+                  "icache: hit %d miss %d evict %d\n"
+                  "dcache: hit %d negative %d miss %d\n"
+                  "bmap: lookups %d blocks %d\n"
+                  "balloc: calls %d bitmap reads %d bits %d bits/call %d freed %d\n"
+                  "delalloc: blocks %d flushes %d swept %d\n"
+                  "prealloc: windows %d blocks returned %d\n",
+                  NINODE + icache.npage*IPP, NINODEMAX, icache.ngrow, icache.nshrink,
+                  icache.nhit, icache.nmiss, icache.nevict,
+                  dcache.nhit, dcache.nneg, dcache.nmiss,
+                  fsstat.nlookup, fsstat.nblock,
+                  n, fsstat.nbitmap, fsstat.nbits, n ? fsstat.nbits / n : 0,
+                  fsstat.nfreed,
+                  fsstat.ndelay, fsstat.nflush, fsstat.nsweep,
+                  fsstat.nprealloc, fsstat.nprefree);
+}
@@ -24,9 +24,15 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+// Number of the nlog log blocks that hold the log header:
+// a count, then the block # of each of the remaining blocks.
+#define LOGHEADBLOCKS(nlog) (((nlog) + 1 + BSIZE/sizeof(uint)) / (BSIZE/sizeof(uint) + 1))
+
+#define NDIRECT 9
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,9 +41,37 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint flags;           // I_* flags
+  uint addrs[NDIRECT+3];   // Data block addresses, or extent tree root
+};
+
+// Inode flags.
+#define I_EXTENT 0x1    // data blocks are mapped by extents
+#define I_INDEX  0x2    // directory is indexed by name hash
+
+// An inode with I_EXTENT set keeps, in place of addrs[], the
+// root of a tree of extents: runs of file blocks that are also
+// contiguous on disk, sorted by file block.  The root holds up
+// to NEXTROOT entries.  At depth 0 they are the extents.  At
+// depth d > 0 each is an index entry for a block of depth d-1,
+// which holds up to NEXTLEAF entries starting at the entry's
+// lblk; a block of depth 0 is a leaf, holding extents.  The
+// tree grows a level when the root and the blocks on its right
+// edge are all full.
+struct extent {
+  uint lblk;     // first file block
+  uint pblk;     // first disk block; leaf block, in an index entry
+  uint len;      // number of blocks; unused in an index entry
 };
 
+struct extenthdr {
+  ushort n;      // entries in use
+  ushort depth;  // 0: entries are extents; else index entries
+};
+
+#define NEXTROOT ((sizeof(uint)*(NDIRECT+3) - sizeof(struct extenthdr)) / sizeof(struct extent))
+#define NEXTLEAF ((BSIZE - sizeof(struct extenthdr)) / sizeof(struct extent))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -58,3 +92,47 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Dirents per directory block.
+#define DPB (BSIZE / sizeof(struct dirent))
+
+// An indexed directory (I_INDEX) keeps its entries in leaf
+// blocks, each an array of DPB dirents, chosen by a hash of
+// the name.  Block 0, the root, holds "." and ".." and then,
+// in slots that look like unused dirents (inum 0), an index
+// of the leaves, sorted by the lowest hash each may hold.
+// Once the root is full it becomes an index of index nodes
+// (depth 1), each of which lists leaves the same way.
+// Small directories, and those that were already larger than
+// a block before indexing, are plain arrays of dirents; so is
+// one whose index could not take another leaf, which reads
+// the same with I_INDEX cleared.
+struct dxentry {
+  ushort inum;     // always 0
+  ushort unused;
+  uint hash;       // lowest name hash in this leaf or node
+  uint block;      // its block number within the directory
+  uint unused1;
+};
+
+#define NDXENTRY ((BSIZE - 3*sizeof(struct dirent)) / sizeof(struct dxentry))
+#define NDXNODE ((BSIZE - sizeof(struct dirent)) / sizeof(struct dxentry))
+
+struct dxroot {
+  struct dirent dot;
+  struct dirent dotdot;
+  ushort inum;     // always 0
+  ushort n;        // index entries in use; e[0].hash is 0
+  ushort depth;    // 0: e[] lists leaves; 1: index nodes
+  ushort unused0;
+  uint unused[2];
+  struct dxentry e[NDXENTRY];
+};
+
+// An index node; e[0].hash is that of its entry in the root.
+struct dxnode {
+  ushort inum;     // always 0
+  ushort n;        // index entries in use
+  uint unused[3];
+  struct dxentry e[NDXNODE];
+};
+
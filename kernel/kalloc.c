@@ -1,6 +1,6 @@
 // Physical memory allocator, for user processes,
-// kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// kernel stacks, page-table pages, pipe buffers,
+// and the buffer cache. Allocates whole 4096-byte pages.
 
 #include "types.h"
 #include "param.h"
@@ -62,11 +62,10 @@ kfree(void *pa)
   release(&kmem.lock);
 }
 
-// Allocate one 4096-byte page of physical memory.
-// Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
-void *
-kalloc(void)
+// Take a page off the free list.
+// Returns 0 if the list is empty.
+static void *
+kpop(void)
 {
   struct run *r;
 
@@ -80,3 +79,26 @@ kalloc(void)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Allocate one 4096-byte page of physical memory.
+// Returns a pointer that the kernel can use.
+// When memory runs out, asks the buffer cache, and then
+// the inode cache, to give back pages before failing.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc(void)
+{
+  void *pa;
+
+  if((pa = kpop()) == 0 && (bshrink() > 0 || ishrink() > 0))
+    pa = kpop();
+  return pa;
+}
+
+// Allocate a page without shrinking the buffer or inode
+// caches, for their own growth.
+void *
+kalloc_noreclaim(void)
+{
+  return kpop();
+}
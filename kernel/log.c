@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -20,187 +21,646 @@
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// Each system call reserves MAXOPBLOCKS blocks of the
+// transaction; one that may write more, like a large
+// write(), reserves more with begin_opn().
+//
+// Commits are grouped.  The log keeps two headers: lh, for the
+// open transaction that system calls join, and clh, for the
+// committed transactions in the on-disk log.  commit() holds
+// off new system calls only while it copies the open
+// transaction's blocks from the cache into log buffers; it then
+// appends them to clh and lets system calls start a new open
+// transaction while it writes the log.  An end_op() that finds
+// a commit in progress leaves its transaction for that commit()
+// to pick up once it is done.
+//
+// Checkpointing is lazy.  Committed blocks are installed to
+// their home locations only when the next transaction does not
+// fit in the rest of the log.  Then only the newest logged
+// version of each block is written, so a block that many
+// transactions modify, like a bitmap or inode block, is
+// installed once.  Until then, the buffer cache reads a
+// committed block that it has let go of from the log, as told
+// by log_block().
+//
+// File data is ordered, not logged.  writei() hands file data
+// blocks to log_data() rather than log_write(); commit() writes
+// them straight to their home locations, alongside the log
+// writes and before the header, so committed metadata never
+// points at data that is not on disk, and the data is written
+// once.  Only a data block that still has an uninstalled copy
+// in the log (it used to hold metadata) is logged after all,
+// so that installing the old copy cannot overwrite it.  For
+// the same reason the allocator does not hand out a block that
+// the open transaction freed (see bfree()): its new contents
+// would go home before the free was on disk.  fsync() uses
+// log_force() to wait for the commit point.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   header blocks, containing the count and
+//     block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// where a block # may appear more than once; the later copy
+// is the newer.  The size of the log comes from the superblock;
+// the header takes as many blocks as it needs of it.
+// Log appends are synchronous: commit() waits for each step's
+// writes before starting the next.  Within a step, all the
+// block writes are submitted (installation, LOGBATCH at a time)
+// before any is waited for, with bsubmitv(), so that blocks
+// next to each other on disk, like the log's own, go in one
+// request.
 
-// Contents of the header block, used for both the on-disk header block
+#define LOGBATCH 16
+#define NLOGHASH 251
+
+// Contents of the header blocks, used for both the on-disk header
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
   int block[LOGSIZE];
 };
 
+// Chained hash from block # to index in a logheader's block[],
+// newest index first.  Links are index+1, so that 0 ends a
+// chain and a zeroed table is empty.
+struct loghash {
+  int head[NLOGHASH];
+  int next[LOGSIZE];
+};
+
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int nhead;       // header blocks, at the start of the log.
+  int size;        // log blocks after the header.
+  int txsize;      // most blocks in one transaction.
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks reserved by them.
+  int copying;     // commit() is copying lh's blocks, please wait.
+  int committing;  // in commit().
+  int active;      // recovered, so system calls join it.
   int dev;
-  struct logheader lh;
+  struct logheader lh;   // the open transaction.
+  struct logheader clh;  // the committed, uninstalled transactions.
+  struct loghash lhash;  // protected by lock.
+  struct loghash chash;  // protected by lock; only committed entries.
+  uchar ldata[LOGTXSIZE]; // lh.block[i] is file data, for log_data().
+  struct buf *dbuf[LOGTXSIZE]; // data blocks commit() is writing.
+
+  // statistics.
+  uint ncommit;
+  uint nop;
+  uint nblock;
+  uint ndata;      // file data blocks written home by commit().
+  uint ndone;      // commits whose header is on disk.
+  uint ncheckpoint;
+  uint ninstall;
+  uint nabsorb;
 };
-struct log log;
+struct log logs[NBDEV];  // indexed by device number
 
-static void recover_from_log(void);
-static void commit();
+static void recover_from_log(struct log*);
+static void commit(struct log*);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
+  struct log *l = &logs[dev];
 
-  initlock(&log.lock, "log");
-  log.start = sb->logstart;
-  log.size = sb->nlog;
-  log.dev = dev;
-  recover_from_log();
+  initlock(&l->lock, "log");
+  l->start = sb->logstart;
+  l->nhead = LOGHEADBLOCKS(sb->nlog);
+  l->size = sb->nlog - l->nhead;
+  if (l->size > LOGSIZE)
+    panic("initlog: log too big");
+  l->txsize = l->size < LOGTXSIZE ? l->size : LOGTXSIZE;
+  l->dev = dev;
+  recover_from_log(l);
+  acquire(&l->lock);
+  l->active = 1;
+  release(&l->lock);
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(void)
+// Index of the newest entry for blockno in lh, or -1.
+static int
+hlookup(struct loghash *h, struct logheader *lh, int blockno)
 {
-  int tail;
+  int i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  for (i = h->head[blockno % NLOGHASH]; i != 0; i = h->next[i-1]) {
+    if (lh->block[i-1] == blockno)
+      return i-1;
   }
+  return -1;
 }
 
-// Read the log header from disk into the in-memory log header
+// Record that lh's entry i is the newest for blockno.
 static void
-read_head(void)
+hinsert(struct loghash *h, int blockno, int i)
+{
+  int *hp = &h->head[blockno % NLOGHASH];
+
+  h->next[i] = *hp;
+  *hp = i+1;
+}
+
+// Forget lh's entries.
+static void
+hclear(struct loghash *h, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
-  brelse(buf);
+
+  for (i = 0; i < lh->n; i++)
+    h->head[lh->block[i] % NLOGHASH] = 0;
+}
+
+// Where to read the committed contents of block blockno
+// from: the newest copy in the log, if it has not been
+// installed yet, or else blockno itself.
+uint
+log_block(uint dev, uint blockno)
+{
+  struct log *l = &logs[dev];
+  int i;
+
+  if (dev >= NBDEV || l->dev != dev)
+    return blockno;
+  acquire(&l->lock);
+  i = hlookup(&l->chash, &l->clh, blockno);
+  release(&l->lock);
+  if (i < 0)
+    return blockno;
+  return l->start + l->nhead + i;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Wait for the installation writes of dbuf[0..n-1] to finish.
+// The committed contents went out from the log buffers'
+// memory; put the cache's own back.
 static void
-write_head(void)
+install_wait(struct buf **lbuf, struct buf **dbuf, int n, int recovering)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  uchar *data;
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+
+  for(i = 0; i < n; i++){
+    bwait(dbuf[i]);
+    if(!recovering){
+      data = dbuf[i]->data;
+      dbuf[i]->data = lbuf[i]->data;
+      lbuf[i]->data = data;
+    }
+    brelse(lbuf[i]);
+    brelse(dbuf[i]);
+  }
+}
+
+// Copy committed blocks from log to their home location,
+// skipping those logged again later.
+// System calls may be running, holding home buffers locked
+// while they bread() others, so a dst buffer is waited for
+// only when the batch is empty: one that is busy ends the
+// batch first.
+static void
+install_trans(struct log *l, int recovering)
+{
+  struct buf *lbuf[LOGBATCH], *dbuf[LOGBATCH];
+  uchar *data;
+  int tail, i, n;
+
+  n = 0;
+  for (tail = 0; tail < l->clh.n; tail++) {
+    acquire(&l->lock);
+    i = hlookup(&l->chash, &l->clh, l->clh.block[tail]);
+    release(&l->lock);
+    if (i != tail) {
+      l->nabsorb++;  // a newer copy follows
+      continue;
+    }
+    l->ninstall++;
+    if (n > 0 && (dbuf[n] = bread_try(l->dev, l->clh.block[tail])) == 0) {
+      bsubmitv(dbuf, n, 1, 0);
+      install_wait(lbuf, dbuf, n, recovering);
+      n = 0;
+    }
+    if (n == 0)
+      dbuf[n] = bread(l->dev, l->clh.block[tail]); // read dst
+    lbuf[n] = bread(l->dev, l->start+l->nhead+tail); // read log block
+    if(recovering){
+      memmove(dbuf[n]->data, lbuf[n]->data, BSIZE);  // copy block to dst
+    } else {
+      // The cached dst may already hold a newer version, from
+      // the open transaction.  Write the committed one straight
+      // from the log buffer by swapping data, which no one else
+      // can see while both buffers are locked.
+      data = dbuf[n]->data;
+      dbuf[n]->data = lbuf[n]->data;
+      lbuf[n]->data = data;
+    }
+    if(++n == LOGBATCH){
+      bsubmitv(dbuf, n, 1, 0);  // write dst to disk
+      install_wait(lbuf, dbuf, n, recovering);
+      n = 0;
+    }
   }
+  bsubmitv(dbuf, n, 1, 0);
+  install_wait(lbuf, dbuf, n, recovering);
+
+  // Every home location is now up to date.
+  acquire(&l->lock);
+  hclear(&l->chash, &l->clh);
+  release(&l->lock);
+}
+
+// Write header block h of clh to disk.
+static void
+write_head_block(struct log *l, int h)
+{
+  struct buf *buf = bread(l->dev, l->start+h);
+  int *hdr = (int *) &l->clh;
+  int nint = BSIZE / sizeof(int);
+  int n;
+
+  n = 1 + LOGSIZE - h*nint;
+  if (n > nint)
+    n = nint;
+  memmove(buf->data, hdr + h*nint, n * sizeof(int));
   bwrite(buf);
   brelse(buf);
 }
 
+// Read the log header from disk into the in-memory log header
 static void
-recover_from_log(void)
+read_head(struct log *l)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  int *hdr = (int *) &l->clh;
+  int nint = BSIZE / sizeof(int);
+  int h, n, i;
+
+  for (h = 0; h < l->nhead && (h == 0 || h*nint <= l->clh.n); h++) {
+    struct buf *buf = bread(l->dev, l->start+h);
+    n = 1 + LOGSIZE - h*nint;
+    if (n > nint)
+      n = nint;
+    memmove(hdr + h*nint, buf->data, n * sizeof(int));
+    brelse(buf);
+  }
+  if (l->clh.n < 0 || l->clh.n > l->size)
+    panic("read_head");
+  for (i = 0; i < l->clh.n; i++)
+    hinsert(&l->chash, l->clh.block[i], i);
 }
 
-// called at the start of each FS system call.
-void
-begin_op(void)
+// Write in-memory log header of the committed transactions
+// to disk, where entries from on are new.  The header block
+// with the count goes last; that is the true point at which
+// the new transaction commits.
+static void
+write_head(struct log *l, int from)
+{
+  int nint = BSIZE / sizeof(int);
+  int h;
+
+  // entry i is int 1+i of the header.
+  for (h = (1+from) / nint; h*nint <= l->clh.n; h++) {
+    if (h > 0)
+      write_head_block(l, h);
+  }
+  write_head_block(l, 0);
+}
+
+static void
+recover_from_log(struct log *l)
+{
+  read_head(l);
+  install_trans(l, 1); // if committed, copy from log to disk
+  l->clh.n = 0;
+  write_head(l, 0); // clear the log
+}
+
+// Join l's open transaction, reserving nblocks blocks.
+static void
+lbegin(struct log *l, int nblocks)
 {
-  acquire(&log.lock);
+  if(nblocks > l->txsize)
+    panic("begin_opn");
+  acquire(&l->lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    if(l->copying){
+      sleep(l, &l->lock);
+    } else if(l->lh.n + l->reserved + nblocks > l->txsize){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      sleep(l, &l->lock);
     } else {
-      log.outstanding += 1;
-      release(&log.lock);
+      l->outstanding += 1;
+      l->reserved += nblocks;
+      release(&l->lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// called at the start of each FS system call that writes
+// at most nblocks blocks.  joins the open transaction of
+// every mounted file system's log, in device order, so that
+// no two processes can each wait for the other's log; the
+// system call's log_write()s go to the log of each block's
+// own device.
 void
-end_op(void)
+begin_opn(int nblocks)
+{
+  struct proc *p = myproc();
+  int dev;
+
+  if(p->oplogs)
+    panic("begin_op: nested");
+  for(dev = 0; dev < NBDEV; dev++){
+    if(logs[dev].active){
+      lbegin(&logs[dev], nblocks);
+      p->oplogs |= 1 << dev;
+    }
+  }
+}
+
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Leave l's open transaction.
+// commits if this was the last outstanding operation,
+// unless a commit is already in progress, which will
+// commit this transaction after its own.
+static void
+lend(struct log *l, int nblocks)
 {
   int do_commit = 0;
 
-  acquire(&log.lock);
-  log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  acquire(&l->lock);
+  l->outstanding -= 1;
+  l->reserved -= nblocks;
+  l->nop++;
+  if(l->outstanding == 0 && !l->committing){
     do_commit = 1;
-    log.committing = 1;
+    l->committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing l->reserved has decreased
     // the amount of reserved space.
-    wakeup(&log);
+    wakeup(l);
   }
-  release(&log.lock);
+  release(&l->lock);
 
   if(do_commit){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+    commit(l);
   }
 }
 
-// Copy modified blocks from cache to log.
-static void
-write_log(void)
+// called at the end of each FS system call, to leave the
+// transactions that begin_opn() joined.
+// nblocks must match begin_opn().
+void
+end_opn(int nblocks)
+{
+  struct proc *p = myproc();
+  int dev;
+
+  for(dev = 0; dev < NBDEV; dev++){
+    if(p->oplogs & (1 << dev))
+      lend(&logs[dev], nblocks);
+  }
+  p->oplogs = 0;
+}
+
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// The number of device dev's open transaction, which changes
+// once commit() has taken its blocks.  A system call sees the
+// same number from begin_op() to end_op().
+uint
+log_tx(int dev)
+{
+  struct log *l = &logs[dev];
+  uint n;
+
+  acquire(&l->lock);
+  n = l->ncommit;
+  release(&l->lock);
+  return n;
+}
+
+// Wait until the updates to device dev of system calls that
+// have called end_op() are on disk: those in the open
+// transaction, or in one that commit() is writing.
+void
+log_force(int dev)
+{
+  struct log *l = &logs[dev];
+  uint n;
+
+  acquire(&l->lock);
+  n = l->ncommit + (l->lh.n > 0 || l->copying);
+  while(l->ndone < n)
+    sleep(l, &l->lock);
+  release(&l->lock);
+}
+
+// The most blocks one system call may reserve, so that
+// a few can share a transaction in every log.
+int
+log_opblocks(void)
+{
+  int dev, n = 0;
+
+  for(dev = 0; dev < NBDEV; dev++){
+    if(logs[dev].active && (n == 0 || logs[dev].txsize / 2 < n))
+      n = logs[dev].txsize / 2;
+  }
+  return n > MAXOPBLOCKS ? n : MAXOPBLOCKS;
+}
+
+// Copy the open transaction's modified blocks from cache into
+// the log buffers following the committed ones, returned
+// locked in to[], and append its entries to clh.  Start
+// writing its data blocks home from the cache, and leave them
+// locked in l->dbuf[0..*nd-1], so that no one changes them
+// until they are written.
+// Returns the number of blocks logged.
+static int
+copy_log(struct log *l, struct buf **to, int *nd)
 {
-  int tail;
+  int tail, n, logged;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+  n = 0;
+  *nd = 0;
+  for (tail = 0; tail < l->lh.n; tail++) {
+    if (l->ldata[tail]) {
+      acquire(&l->lock);
+      logged = hlookup(&l->chash, &l->clh, l->lh.block[tail]) >= 0;
+      release(&l->lock);
+      if (!logged) {
+        l->dbuf[(*nd)++] = bread(l->dev, l->lh.block[tail]);
+        continue;
+      }
+    }
+    to[n] = bread(l->dev, l->start+l->nhead+l->clh.n+n); // log block
+    struct buf *from = bread(l->dev, l->lh.block[tail]); // cache block
+    memmove(to[n]->data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
+    l->clh.block[l->clh.n+n] = l->lh.block[tail];
+    n++;
+  }
+  bsubmitv(l->dbuf, *nd, 1, 0);
+  l->clh.n += n;
+  acquire(&l->lock);
+  hclear(&l->lhash, &l->lh);
+  l->lh.n = 0;
+  release(&l->lock);
+  return n;
+}
+
+// Install the committed transactions and empty the log.
+// System calls may run meanwhile: installation leaves the
+// cache alone.
+static void
+checkpoint(struct log *l)
+{
+  install_trans(l, 0);
+  l->clh.n = 0;
+  write_head(l, 0);
+  l->ncheckpoint++;
+}
+
+// Write the log buffers to disk, all at once.
+static void
+write_log(struct buf **to, int n)
+{
+  int i;
+
+  bsubmitv(to, n, 1, 0);  // write the log
+  for (i = 0; i < n; i++) {
+    bwait(to[i]);
+    brelse(to[i]);
   }
 }
 
+// Wait for the data block writes copy_log() started, and let
+// the cache evict those blocks.
 static void
-commit()
+write_data(struct log *l, int nd)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int i;
+
+  for (i = 0; i < nd; i++) {
+    bwait(l->dbuf[i]);
+    bunpin(l->dbuf[i]);
+    brelse(l->dbuf[i]);
   }
 }
 
+// The newly committed blocks clh.block[from..] can be read
+// from the log now; let the cache evict them.
+static void
+unpin_log(struct log *l, int from)
+{
+  struct buf *b;
+  int i;
+
+  acquire(&l->lock);
+  for (i = from; i < l->clh.n; i++)
+    hinsert(&l->chash, l->clh.block[i], i);
+  release(&l->lock);
+
+  for (i = from; i < l->clh.n; i++) {
+    b = bread(l->dev, l->clh.block[i]);
+    bunpin(b);
+    brelse(b);
+  }
+}
+
+// Commit the open transaction, and then any that completes
+// while this one is being written.  Caller has set
+// l->committing.
+static void
+commit(struct log *l)
+{
+  struct buf *to[LOGTXSIZE];
+  int n, nd, from;
+
+  acquire(&l->lock);
+  while(l->outstanding == 0 && l->lh.n > 0){
+    if(l->clh.n + l->lh.n > l->size){
+      // No room after the committed transactions.
+      release(&l->lock);
+      checkpoint(l);
+      acquire(&l->lock);
+      continue;
+    }
+
+    // No system call is in the open transaction; hold off
+    // new ones while its blocks are copied.
+    l->copying = 1;
+    release(&l->lock);
+    from = l->clh.n;
+    n = copy_log(l, to, &nd);
+    acquire(&l->lock);
+    l->copying = 0;
+    l->ncommit++;
+    l->nblock += n;
+    l->ndata += nd;
+    wakeup(l);
+    release(&l->lock);
+
+    write_log(to, n); // Write modified blocks from cache to log
+    write_data(l, nd);   // Data must be home before the commit
+    write_head(l, from); // Write header to disk -- the real commit
+    unpin_log(l, from);
+
+    acquire(&l->lock);
+    l->ndone++;
+    wakeup(l);
+  }
+  l->committing = 0;
+  wakeup(l);
+  release(&l->lock);
+}
+
+// Add b to the open transaction, as file data if data is set.
+// The last call for a block in a transaction decides which.
+static void
+log_add(struct log *l, struct buf *b, int data)
+{
+  int i;
+
+  if (l->lh.n >= l->txsize)
+    panic("too big a transaction");
+  if (l->outstanding < 1)
+    panic("log_write outside of trans");
+
+  acquire(&l->lock);
+  i = hlookup(&l->lhash, &l->lh, b->blockno);  // log absorbtion
+  if (i < 0) {  // Add new block to log?
+    i = l->lh.n++;
+    l->lh.block[i] = b->blockno;
+    hinsert(&l->lhash, b->blockno, i);
+    bpin(b);
+  }
+  l->ldata[i] = data;
+  release(&l->lock);
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
 // commit()/write_log() will do the disk write.
@@ -213,23 +673,35 @@ commit()
 void
 log_write(struct buf *b)
 {
-  int i;
+  log_add(&logs[b->dev], b, 0);
+}
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
-  if (log.outstanding < 1)
-    panic("log_write outside of trans");
+// Like log_write(), for a block of file data, which commit()
+// writes home rather than to the log.
+void
+log_data(struct buf *b)
+{
+  log_add(&logs[b->dev], b, 1);
+}
 
-  acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
-      break;
-  }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
-    bpin(b);
-    log.lh.n++;
+// Report how well commits are grouped, for the fsstats device.
+// One set of lines per mounted file system, root first.
+int
+statslog(char *buf, int sz)
+{
+  struct log *l;
+  int n = 0;
+
+  for(l = logs; l < logs+NBDEV && sz - n > 256; l++){
+    if(!l->active)
+      continue;
+    n += snprintf(buf+n, sz-n,
+                  "log: commits %d ops %d blocks %d data %d\n"
+                  "log: checkpoints %d installed %d absorbed %d\n"
+                  "log: size %d transaction %d dev %d\n",
+                  l->ncommit, l->nop, l->nblock, l->ndata,
+                  l->ncheckpoint, l->ninstall, l->nabsorb,
+                  l->size, l->txsize, l->dev);
   }
-  release(&log.lock);
+  return n;
 }
-
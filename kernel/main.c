@@ -12,9 +12,7 @@ main()
 {
   if(cpuid() == 0){
     consoleinit();
-#if defined(LAB_PGTBL) || defined(LAB_LOCK)
     statsinit();
-#endif
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
@@ -30,12 +28,16 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
-    virtio_disk_init(); // emulated hard disk
+#ifdef RAMDISK_ROOT
+    ramdiskinit();   // file system image loaded by qemu -initrd
+#endif
+    virtio_disk_init(); // emulated hard disks
 #ifdef LAB_NET
     pci_init();
     sockinit();
 #endif    
     userinit();      // first user process
+    kproc("iflushd", iflushd); // writes delayed file data
     __sync_synchronize();
     started = 1;
   } else {
@@ -8,8 +8,11 @@
 // 0C000000 -- PLIC
 // 10000000 -- uart0 
 // 10001000 -- virtio disk 
+// 10002000 -- ... NVIRTIO virtio mmio slots in all
 // 80000000 -- boot ROM jumps here in machine mode
 //             -kernel loads the kernel here
+// 88000000 -- -initrd loads the ramdisk image here, if
+//             there are at least 256MB of RAM
 // unused RAM after 80000000.
 
 // the kernel uses physical memory thus:
@@ -24,6 +27,8 @@
 // virtio mmio interface
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
+#define NVIRTIO 8   // slot i is at VIRTIO(i), with irq VIRTIO0_IRQ+i
+#define VIRTIO(i) (VIRTIO0 + (i)*0x1000)
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
@@ -47,6 +52,10 @@
 #define KERNBASE 0x80000000L
 #define PHYSTOP (KERNBASE + 128*1024*1024)
 
+// the file system image that qemu -initrd loads, for
+// ramdisk.c, just past the RAM the kernel uses.
+#define RAMDISK PHYSTOP
+
 // map the trampoline page to the highest address,
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
@@ -2,12 +2,18 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // i-nodes cached before the cache grows
+#define NINODEMAX  1000  // i-node cache may grow to this many i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define NBDEV         4  // block devices are numbered below this
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      1024  // max data blocks in on-disk log
+#define LOGTXSIZE    (MAXOPBLOCKS*8)  // max data blocks in one log transaction
+#define NBUF         (LOGTXSIZE*4)  // static size of disk block cache
+#define NBUFMAX      4096  // disk block cache may grow to this many buffers
+#ifndef FSSIZE
+#define FSSIZE       70000  // size of file system in blocks; make FSSIZE=n
+#endif
 #define MAXPATH      128   // maximum file path name
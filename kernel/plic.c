@@ -13,7 +13,8 @@ plicinit(void)
 {
   // set desired IRQ priorities non-zero (otherwise disabled).
   *(uint32*)(PLIC + UART0_IRQ*4) = 1;
-  *(uint32*)(PLIC + VIRTIO0_IRQ*4) = 1;
+  for(int i = 0; i < NVIRTIO; i++)
+    *(uint32*)(PLIC + (VIRTIO0_IRQ+i)*4) = 1;
 }
 
 void
@@ -22,7 +23,8 @@ plicinithart(void)
   int hart = cpuid();
   
   // set uart's enable bit for this hart's S-mode. 
-  *(uint32*)PLIC_SENABLE(hart)= (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  *(uint32*)PLIC_SENABLE(hart)= (1 << UART0_IRQ) |
+    (((1 << NVIRTIO) - 1) << VIRTIO0_IRQ);
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
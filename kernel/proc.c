@@ -262,6 +262,22 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel process, named name, that runs fn() in the
+// kernel and never returns.  Like forkret(), fn() is entered
+// holding p->lock, and must release it first.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  p->context.ra = (uint64)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
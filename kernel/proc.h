@@ -106,4 +106,6 @@ struct proc {
 
   // each process have its own kernel page table
  pagetable_t kernel_pagetable; 
+
+  int oplogs;                  // logs joined by begin_op(), a bit per device
 };
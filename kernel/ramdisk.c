@@ -1,6 +1,11 @@
 //
 // ramdisk that uses the disk image loaded by qemu -initrd fs.img
 //
+// make RAMDISK=1 qemu boots from it instead of the virtio
+// disk.  Reads and writes are memmove()s, so file system code
+// can be measured without device latency.  Writes change only
+// memory; fs.img itself is not touched.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -12,34 +17,56 @@
 #include "fs.h"
 #include "buf.h"
 
-void
-ramdiskinit(void)
+// Copy b to or from the image, then finish it as the virtio
+// interrupt handler would.
+static void
+ramdiskstart(struct buf *b, int write)
 {
+  void (*done)(struct buf*);
+  char *addr;
+
+  if(b->ioblock >= FSSIZE)
+    panic("ramdiskstart: blockno too big");
+  addr = (char *)RAMDISK + (uint64)b->ioblock * BSIZE;
+  if(write)
+    memmove(addr, b->data, BSIZE);
+  else
+    memmove(b->data, addr, BSIZE);
+
+  done = b->iodone;
+  b->iodone = 0;
+  b->disk = 0;
+  if(done)
+    done(b);
 }
 
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-ramdiskrw(struct buf *b)
+static void
+ramdiskstartv(struct buf **bs, int n, int write)
 {
-  if(!holdingsleep(&b->lock))
-    panic("ramdiskrw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("ramdiskrw: nothing to do");
+  for(int i = 0; i < n; i++)
+    ramdiskstart(bs[i], write);
+}
 
-  if(b->blockno >= FSSIZE)
-    panic("ramdiskrw: blockno too big");
+// I/O is finished by the time ramdiskstart() returns.
+static void
+ramdiskwait(struct buf *b)
+{
+  if(b->disk)
+    panic("ramdiskwait");
+}
 
-  uint64 diskaddr = b->blockno * BSIZE;
-  char *addr = (char *)RAMDISK + diskaddr;
+void
+ramdiskinit(void)
+{
+  struct superblock *sb = (struct superblock *)(RAMDISK + BSIZE);
+  struct bdevsw sw;
 
-  if(b->flags & B_DIRTY){
-    // write
-    memmove(addr, b->data, BSIZE);
-    b->flags &= ~B_DIRTY;
-  } else {
-    // read
-    memmove(b->data, addr, BSIZE);
-    b->flags |= B_VALID;
-  }
+  if(sb->magic != FSMAGIC)
+    panic("ramdisk: no file system; was fs.img loaded with -initrd?");
+  sw.start = ramdiskstart;
+  sw.startv = ramdiskstartv;
+  sw.wait = ramdiskwait;
+  sw.unit = 0;
+  if(bregister(&sw) != ROOTDEV)
+    panic("ramdiskinit");
 }
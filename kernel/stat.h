@@ -9,3 +9,16 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// getdents() fills in an array of these, one per entry.
+struct dirstat {
+  uint ino;       // Inode number
+  char name[16];  // Name, NUL-terminated
+  struct stat st; // Stat of the inode, if GD_STAT
+};
+
+#define GD_STAT 0x1   // getdents(): fill in each entry's st
+
+// fsetmap(): how an empty file maps its data blocks.
+#define FM_BLOCKS  0  // by direct and indirect block numbers
+#define FM_EXTENTS 1  // by extents; what create() gives new files
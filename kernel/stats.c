@@ -10,12 +10,15 @@
 #include "defs.h"
 
 #define BUFSZ 4096
-static struct {
+struct statsbuf {
   struct spinlock lock;
   char buf[BUFSZ];
   int sz;
   int off;
-} stats;
+};
+
+static struct statsbuf stats;    // the statistics device
+static struct statsbuf fsstats;  // the fsstats device
 
 int statscopyin(char*, int);
 int statslock(char*, int);
@@ -26,44 +29,85 @@ statswrite(int user_src, uint64 src, int n)
   return -1;
 }
 
-int
-statsread(int user_dst, uint64 dst, int n)
+// Hand out the text that fill() produced, n bytes at a time.
+// Returns -1 once it has all been read, and fills the buffer
+// afresh on the next read.
+static int
+statsbufread(struct statsbuf *st, int (*fill)(char*, int),
+             int user_dst, uint64 dst, int n)
 {
   int m;
 
-  acquire(&stats.lock);
+  acquire(&st->lock);
 
-  if(stats.sz == 0) {
-#ifdef LAB_PGTBL
-    stats.sz = statscopyin(stats.buf, BUFSZ);
-#endif
-#ifdef LAB_LOCK
-    stats.sz = statslock(stats.buf, BUFSZ);
-#endif
-  }
-  m = stats.sz - stats.off;
+  if(st->sz == 0 && fill)
+    st->sz = fill(st->buf, BUFSZ);
+  m = st->sz - st->off;
 
   if (m > 0) {
     if(m > n)
       m  = n;
-    if(either_copyout(user_dst, dst, stats.buf+stats.off, m) != -1) {
-      stats.off += m;
+    if(either_copyout(user_dst, dst, st->buf+st->off, m) != -1) {
+      st->off += m;
     }
   } else {
     m = -1;
-    stats.sz = 0;
-    stats.off = 0;
+    st->sz = 0;
+    st->off = 0;
   }
-  release(&stats.lock);
+  release(&st->lock);
   return m;
 }
 
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int (*fill)(char*, int) = 0;
+
+#ifdef LAB_PGTBL
+  fill = statscopyin;
+#endif
+#ifdef LAB_LOCK
+  fill = statslock;
+#endif
+  return statsbufread(&stats, fill, user_dst, dst, n);
+}
+
+// Collect the file system and disk counters.
+// Each line is bounded well below BUFSZ, so stop
+// asking once less than a line's worth of room is left.
+static int
+fsstatsfill(char *buf, int sz)
+{
+  static int (*fills[])(char*, int) = {
+    statsbio,
+    statsdisk,
+    statslog,
+    statsfs,
+  };
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NELEM(fills) && sz - n > 256; i++)
+    n += fills[i](buf+n, sz-n-128);
+  return n;
+}
+
+int
+fsstatsread(int user_dst, uint64 dst, int n)
+{
+  return statsbufread(&fsstats, fsstatsfill, user_dst, dst, n);
+}
+
 void
 statsinit(void)
 {
   initlock(&stats.lock, "stats");
+  initlock(&fsstats.lock, "fsstats");
 
   devsw[STATS].read = statsread;
   devsw[STATS].write = statswrite;
+  devsw[FSSTATS].read = fsstatsread;
+  devsw[FSSTATS].write = statswrite;
 }
 
@@ -104,6 +104,17 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_fallocate(void);
+extern uint64 sys_diskpoll(void);
+extern uint64 sys_mount(void);
+extern uint64 sys_fsetmap(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +138,17 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_getdents] sys_getdents,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_sendfile] sys_sendfile,
+[SYS_fsync]   sys_fsync,
+[SYS_fallocate] sys_fallocate,
+[SYS_diskpoll] sys_diskpoll,
+[SYS_mount]   sys_mount,
+[SYS_fsetmap] sys_fsetmap,
 };
 
 void
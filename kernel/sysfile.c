@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -91,6 +92,178 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Fetch the nth system call argument as a user array of
+// *pcnt struct iovec, with *pcnt the n+1th argument, and
+// copy it into iov[IOV_MAX].  Their lengths must add up to
+// at most IOV_TOTMAX.
+static int
+argiov(int n, struct iovec *iov, int *pcnt)
+{
+  uint64 addr, tot;
+  int i;
+
+  if(argaddr(n, &addr) < 0 || argint(n+1, pcnt) < 0)
+    return -1;
+  if(*pcnt < 0 || *pcnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, *pcnt * sizeof(*iov)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < *pcnt; i++){
+    if(iov[i].iov_len < 0)
+      return -1;
+    tot += iov[i].iov_len;
+  }
+  if(tot > IOV_TOTMAX)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+// Copy up to n bytes from file in to file out in the kernel.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesendfile(out, in, n);
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f);
+}
+
+// Reserve disk blocks for bytes off..off+len-1 of file fd,
+// all or none; fails for a file with FM_BLOCKS.
+uint64
+sys_fallocate(void)
+{
+  struct file *f;
+  int off, len;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &len) < 0)
+    return -1;
+  if(off < 0 || len <= 0)
+    return -1;
+  return filefallocate(f, off, len);
+}
+
+// Choose how empty file fd maps its data blocks: FM_EXTENTS
+// or FM_BLOCKS.
+uint64
+sys_fsetmap(void)
+{
+  struct file *f;
+  int map;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &map) < 0)
+    return -1;
+  if(map != FM_BLOCKS && map != FM_EXTENTS)
+    return -1;
+  return filesetmap(f, map);
+}
+
+// Set how many times a process waiting for the disk checks
+// for its request before sleeping; 0 turns polling off.
+uint64
+sys_diskpoll(void)
+{
+  int spin;
+
+  if(argint(0, &spin) < 0 || spin < 0)
+    return -1;
+  return virtio_disk_poll(spin);
+}
+
+// Mount the file system on block device dev on directory path.
+uint64
+sys_mount(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  int dev;
+
+  if(argint(0, &dev) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  if(ip->type != T_DIR){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+  iunlock(ip);
+  end_op();
+
+  if(fsmount(dev, ip) < 0){
+    begin_op();
+    iput(ip);
+    end_op();
+    return -1;
+  }
+  return 0;
+}
+
 uint64
 sys_close(void)
 {
@@ -115,6 +288,20 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Read up to n entries of directory fd into the array
+// of struct dirstat at addr.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 addr;
+  int n, flags;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0 || argint(3, &flags) < 0)
+    return -1;
+  return filegetdents(f, addr, n, flags);
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -185,7 +372,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -206,6 +392,10 @@ sys_unlink(void)
 
   if((ip = dirlookup(dp, name, &off)) == 0)
     goto bad;
+  if(mounted(ip)){
+    iput(ip);
+    goto bad;
+  }
   ilock(ip);
 
   if(ip->nlink < 1)
@@ -215,9 +405,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -265,18 +453,30 @@ create(char *path, short type, short major, short minor)
   ip->major = major;
   ip->minor = minor;
   ip->nlink = 1;
+  if(type == T_FILE)
+    ip->flags = I_EXTENT;  // new files map their blocks by extents
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
-    dp->nlink++;  // for ".."
-    iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  // dirlink() does not fail now that dp's index can always
+  // grow or give way to a plain list; back out if it does.
+  if(dirlink(dp, name, ip->inum) < 0){
+    ip->nlink = 0;   // so that iput() frees ip
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
+
+  if(type == T_DIR){
+    dp->nlink++;  // for ".."
+    iupdate(dp);
+  }
 
   iunlockput(dp);
 
@@ -0,0 +1,8 @@
+// Scatter/gather I/O: readv() and writev() take an array of these.
+struct iovec {
+  void *iov_base;  // start of a buffer
+  int iov_len;     // its length in bytes
+};
+
+#define IOV_MAX 16   // most iovecs that readv() and writev() take
+#define IOV_TOTMAX 0x7fffffff  // most bytes they move, so the count fits an int
@@ -43,9 +43,10 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// this many virtio descriptors.
+// at most this many virtio descriptors; the queue gets as
+// many as the device allows, up to NUM.
 // must be a power of two.
-#define NUM 8
+#define NUM 256
 
 struct VRingDesc {
   uint64 addr;
@@ -56,6 +57,9 @@ struct VRingDesc {
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
 
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // in avail[0]: driver doesn't want interrupts
+#define VRING_USED_F_NO_NOTIFY     1 // in used->flags: device doesn't want notifies
+
 struct VRingUsedElem {
   uint32 id;   // index of start of completed descriptor chain
   uint32 len;
@@ -65,6 +69,15 @@ struct VRingUsedElem {
 #define VIRTIO_BLK_T_IN  0 // read the disk
 #define VIRTIO_BLK_T_OUT 1 // write the disk
 
+// the format of the first descriptor in a disk request.
+// to be followed by two more descriptors containing
+// the block, and a one-byte status.
+struct virtio_blk_outhdr {
+  uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
+  uint32 reserved;
+  uint64 sector;
+};
+
 struct UsedArea {
   uint16 flags;
   uint16 id;
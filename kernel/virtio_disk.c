@@ -1,10 +1,14 @@
 //
-// driver for qemu's virtio disk device.
+// driver for qemu's virtio disk devices.
 // uses qemu's mmio interface to virtio.
 // qemu presents a "legacy" virtio interface.
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// each of the NVIRTIO mmio slots that holds a block device
+// becomes a disk with its own queue, elevator, and lock, and
+// is registered with bio under the next free device number.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -16,50 +20,114 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "elevator.h"
 #include "proc.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(r) ((volatile uint32 *)(d->base + (r)))
+
+// the most blocks in one request: a header descriptor,
+// one descriptor per block, and a status descriptor must
+// also fit in the queue.
+#define MAXSEG 64
 
-static struct disk {
+struct disk {
  // memory for virtio descriptors &c for queue 0.
  // this is a global instead of allocated because it must
  // be multiple contiguous pages, which kalloc()
  // doesn't support, and page aligned.
-  char pages[2*PGSIZE];
+ // with NUM descriptors, the descriptors and avail ring
+ // take just over a page, and the used ring, which must
+ // start on a page, most of another.
+  char pages[3*PGSIZE];
   struct VRingDesc *desc;
   uint16 *avail;
   struct UsedArea *used;
 
   // our own book-keeping.
+  uint64 base;     // mmio registers
+  int dev;         // device number, or 0 if no disk
+  int num;         // descriptors in the queue; a power of two <= NUM.
+  int maxseg;      // most blocks in one request.
+  int qdepth;      // most requests the device has at once: as
+                   // many as fit of the shortest, 3 descriptors.
+                   // the rest wait in the elevator, which sorts
+                   // and merges them.
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 freeidx[NUM]; // the free descriptors, a stack ...
+  int nfree;           // ... this deep.
+  uint16 used_idx; // we've looked this far in used[2..num], mod 2^16.
+  uint16 kicked;   // avail[1] when the device was last notified.
+
+  // with VIRTIO_RING_F_EVENT_IDX, each side tells the other
+  // how far its ring must get before it wants to hear.
+  int eventidx;
+  volatile uint16 *used_event;  // after avail[]: interrupt past here.
+  volatile uint16 *avail_event; // after used->elems[]: notify past here.
+
+  struct elevator elv; // requests not yet given to the device
+
+  // the request dispatch() and virtio_disk_submit() are
+  // building.  kept here rather than on the stack, since they
+  // also run from the interrupt handler, on top of whatever
+  // system call the hart was in.
+  struct buf *seg[MAXSEG];  // its blocks
+  int segidx[MAXSEG+2];     // its descriptors
+
+  int pollspin;    // check the used ring this often before sleeping.
+  int npoll;       // harts polling now; interrupts are off while > 0.
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
-  // indexed by first descriptor index of chain.
+  // b is indexed by the descriptor that carries b->data;
+  // status and hdr by the first descriptor of the chain.
+  // the request header lives here rather than on the
+  // submitter's stack, so that the submitter need not
+  // wait for the request to finish.
   struct {
     struct buf *b;
     char status;
+    struct virtio_blk_outhdr hdr;
   } info[NUM];
   
   struct spinlock vdisk_lock;
+
+  // statistics.
+  uint nreq;       // requests
+  uint nblock;     // ... and the blocks they carried
+  int depth;       // requests the device has now
+  uint depthsum;   // depth after each request was queued, summed
+  int maxdepth;
+  uint niowait;    // waits in virtio_disk_wait()
+  uint ioticks;    // ... and their ticks
+  uint nintr;      // interrupts
+  uint nnotify;    // notifies sent ...
+  uint nquiet;     // ... and not needed
+  uint npolls;     // waits that polled
+  uint npolled;    // requests that polling found done
+  uint npolltimeout; // polls that gave up and slept
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+} __attribute__ ((aligned (PGSIZE)));
 
-void
-virtio_disk_init(void)
+// indexed by mmio slot.
+static struct disk disks[NVIRTIO];
+
+// set up the disk in mmio slot i, if it holds one.
+static void
+virtio_disk_init1(struct disk *d, int i)
 {
   uint32 status = 0;
+  struct bdevsw sw;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
-
+  d->base = VIRTIO(i);
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 1 ||
      *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
      *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+    return;   // no disk here
   }
+
+  initlock(&d->vdisk_lock, "virtio_disk");
   
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
   *R(VIRTIO_MMIO_STATUS) = status;
@@ -74,9 +142,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  d->eventidx = (features >> VIRTIO_RING_F_EVENT_IDX) & 1;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -93,180 +161,464 @@ virtio_disk_init(void)
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
-  if(max < NUM)
+  // the biggest power of two that both sides allow.
+  for(d->num = NUM; d->num > max; d->num /= 2)
+    ;
+  if(d->num < 8)
     panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+  d->maxseg = d->num - 2 < MAXSEG ? d->num - 2 : MAXSEG;
+  d->qdepth = d->num / 3;
+  *R(VIRTIO_MMIO_QUEUE_NUM) = d->num;
+  *R(VIRTIO_MMIO_QUEUE_ALIGN) = PGSIZE;
+  memset(d->pages, 0, sizeof(d->pages));
+  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)d->pages) >> PGSHIFT;
 
   // desc = pages -- num * VRingDesc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
-  // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
-
-  disk.desc = (struct VRingDesc *) disk.pages;
-  disk.avail = (uint16*)(((char*)disk.desc) + NUM*sizeof(struct VRingDesc));
-  disk.used = (struct UsedArea *) (disk.pages + PGSIZE);
+  // avail = pages + num*16 -- 2 * uint16, then num * uint16,
+  //   then used_event
+  // used = the next page -- 2 * uint16, then num * vRingUsedElem,
+  //   then avail_event
+
+  d->desc = (struct VRingDesc *) d->pages;
+  d->avail = (uint16*)(((char*)d->desc) + d->num*sizeof(struct VRingDesc));
+  d->used = (struct UsedArea *)
+    (d->pages + PGROUNDUP(d->num*sizeof(struct VRingDesc) + (3+d->num)*sizeof(uint16)));
+  d->used_event = d->avail + 2 + d->num;
+  d->avail_event = (uint16*)&d->used->elems[d->num];
+
+  for(int i = 0; i < d->num; i++){
+    d->free[i] = 1;
+    d->freeidx[i] = d->num - 1 - i;
+  }
+  d->nfree = d->num;
+
+  sw.start = virtio_disk_start;
+  sw.startv = virtio_disk_startv;
+  sw.wait = virtio_disk_wait;
+  sw.unit = i;
+  if((d->dev = bregister(&sw)) < 0){
+    printf("virtio disk %d: no device number left\n", i);
+    d->dev = 0;
+  }
 
-  for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ+i.
+}
 
-  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+void
+virtio_disk_init(void)
+{
+  for(int i = 0; i < NVIRTIO; i++)
+    virtio_disk_init1(&disks[i], i);
 }
 
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
-  for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
-      return i;
-    }
-  }
-  return -1;
+  int i;
+
+  if(d->nfree == 0)
+    return -1;
+  i = d->freeidx[--d->nfree];
+  d->free[i] = 0;
+  return i;
 }
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
-  if(i >= NUM)
+  if(i >= d->num)
     panic("virtio_disk_intr 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("virtio_disk_intr 2");
-  disk.desc[i].addr = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->free[i] = 1;
+  d->freeidx[d->nfree++] = i;
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    free_desc(i);
-    if(disk.desc[i].flags & VRING_DESC_F_NEXT)
-      i = disk.desc[i].next;
+    free_desc(d, i);
+    if(d->desc[i].flags & VRING_DESC_F_NEXT)
+      i = d->desc[i].next;
     else
       break;
   }
 }
 
+// allocate n descriptors, all or none.
 static int
-alloc3_desc(int *idx)
+alloc_descs(struct disk *d, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
+  if(d->nfree < n)
+    return -1;
+  for(int i = 0; i < n; i++){
+    idx[i] = alloc_desc(d);
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+        free_desc(d, idx[j]);
       return -1;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// tell the device about requests queued since the last
+// kick(), unless it has said it will look anyway.
+// caller must hold d->vdisk_lock.
+static void
+kick(struct disk *d)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint16 old = d->kicked, new = d->avail[1];
+  int need;
+
+  if(old == new)
+    return;
+  d->kicked = new;
+  __sync_synchronize();
+  if(d->eventidx)
+    need = (uint16)(new - *d->avail_event - 1) < (uint16)(new - old);
+  else
+    need = (*(volatile uint16*)&d->used->flags & VRING_USED_F_NO_NOTIFY) == 0;
+  if(need){
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    d->nnotify++;
+  } else {
+    d->nquiet++;
+  }
+}
 
-  acquire(&disk.vdisk_lock);
+// queue one request to read or write bs[0..n-1], whose
+// ioblocks must be consecutive, n <= d->maxseg, and for
+// which n+2 descriptors are free.
+// caller must hold d->vdisk_lock.
+// the caller must kick() the device afterwards.
+// complete() clears each b->disk when the request is done,
+// and then calls b->iodone, if set, or else wakes up
+// virtio_disk_wait().
+static void
+virtio_disk_submit(struct disk *d, struct buf **bs, int n, int write)
+{
+  uint64 sector = bs[0]->ioblock * (BSIZE / 512);
 
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
+  // the spec says that legacy block operations use a
+  // descriptor for type/reserved/sector, then the data,
+  // which may take several descriptors, then one for a
+  // 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  // allocate the descriptors.
+  int *idx = d->segidx;
+  if(alloc_descs(d, idx, n + 2) != 0)
+    panic("virtio_disk_submit");
   
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr *buf0 = &d->info[idx[0]].hdr;
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  struct proc *p = myproc();
-  disk.desc[idx[0]].addr = (uint64) vmpa(p->kernel_pagetable, (uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = sector;
+
+  // disk is a direct-mapped global, so the header's
+  // kernel address is its physical address.
+  d->desc[idx[0]].addr = (uint64) buf0;
+  d->desc[idx[0]].len = sizeof(*buf0);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
+
+  for(int i = 0; i < n; i++){
+    int j = idx[1+i];
+    d->desc[j].addr = (uint64) bs[i]->data;
+    d->desc[j].len = BSIZE;
+    if(write)
+      d->desc[j].flags = 0; // device reads b->data
+    else
+      d->desc[j].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d->desc[j].flags |= VRING_DESC_F_NEXT;
+    d->desc[j].next = idx[2+i];
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+    // record struct buf for virtio_disk_intr().
+    bs[i]->disk = 1;
+    d->info[j].b = bs[i];
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  d->info[idx[0]].status = 0;
+  d->desc[idx[n+1]].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[idx[n+1]].len = 1;
+  d->desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d->desc[idx[n+1]].next = 0;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
   // avail[2...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+  d->avail[2 + (d->avail[1] % d->num)] = idx[0];
   __sync_synchronize();
-  disk.avail[1] = disk.avail[1] + 1;
+  d->avail[1] = d->avail[1] + 1;
+
+  d->nreq++;
+  d->nblock += n;
+  d->depthsum += ++d->depth;
+  if(d->depth > d->maxdepth)
+    d->maxdepth = d->depth;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// give the device requests from the elevator until it has
+// d->qdepth of them or too few descriptors are free.
+// the caller must kick() the device afterwards.
+// caller must hold d->vdisk_lock.
+static void
+dispatch(struct disk *d)
+{
+  int n, max, write;
+
+  while(d->depth < d->qdepth){
+    max = d->nfree - 2 < d->maxseg ? d->nfree - 2 : d->maxseg;
+    if((n = elvnext(&d->elv, d->seg, max, &write)) == 0)
+      break;
+    virtio_disk_submit(d, d->seg, n, write);
+  }
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// queue bs[0..n-1] to be read or written, and give the
+// device what it has room for.
+// caller must hold d->vdisk_lock.
+static void
+queue(struct disk *d, struct buf **bs, int n, int write)
+{
+  for(int i = 0; i < n; i++){
+    bs[i]->disk = 1;
+    elvadd(&d->elv, bs[i], write);
+  }
+  dispatch(d);
+  kick(d);
+}
+
+// ask the device to interrupt when the next request is done,
+// or not to interrupt at all while a hart is polling.
+// returns whether requests finished before the device could
+// have seen the change, which may not interrupt.
+// caller must hold d->vdisk_lock.
+static int
+arm(struct disk *d)
+{
+  if(d->eventidx)
+    *d->used_event = d->npoll ? d->used_idx - 1 : d->used_idx;
+  else
+    d->avail[0] = d->npoll ? VRING_AVAIL_F_NO_INTERRUPT : 0;
+  __sync_synchronize();
+  return *(volatile uint16*)&d->used->id != d->used_idx;
+}
+
+// finish every request the device has put in the used ring,
+// and return how many there were.
+// caller must hold d->vdisk_lock.
+static int
+complete(struct disk *d)
+{
+  struct buf *b;
+  void (*done)(struct buf*);
+  int n = 0;
+
+  do {
+    while(d->used_idx != *(volatile uint16*)&d->used->id){
+      __sync_synchronize();
+      int id = d->used->elems[d->used_idx % d->num].id;
+
+      if(d->info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      // every descriptor between the header and the
+      // status carries a buf.
+      for(int i = d->desc[id].next; d->desc[i].flags & VRING_DESC_F_NEXT; i = d->desc[i].next){
+        b = d->info[i].b;
+        d->info[i].b = 0;
+        done = b->iodone;
+        b->iodone = 0;
+        b->disk = 0;   // disk is done with buf
+        if(done)
+          done(b);
+        else
+          wakeup(b);
+      }
+      free_chain(d, id);
+      d->depth--;
+      n++;
+
+      d->used_idx++;
+    }
+  } while(arm(d));
+
+  // the device has room for more.
+  if(n > 0){
+    dispatch(d);
+    kick(d);
+  }
+  return n;
+}
+
+// check the used ring for b's request up to d->pollspin
+// times, with the device's interrupts off, finishing what
+// turns up, so that a short request costs no interrupt and
+// no sleep.
+// caller must hold d->vdisk_lock.
+static void
+poll(struct disk *d, struct buf *b)
+{
+  int spin = 0;
+  uint16 seen;
+
+  d->npolls++;
+  d->npoll++;
+  d->npolled += complete(d);
+  while(b->disk == 1 && spin < d->pollspin){
+    seen = d->used_idx;
+    release(&d->vdisk_lock);
+    while(*(volatile uint16*)&d->used->id == seen && spin < d->pollspin)
+      spin++;
+    acquire(&d->vdisk_lock);
+    d->npolled += complete(d);
+  }
+  if(b->disk == 1)
+    d->npolltimeout++;
+  d->npoll--;
+  complete(d);   // turn interrupts back on.
+}
+
+// wait until the disk is done with b, counting the wait.
+// caller must hold d->vdisk_lock.
+static void
+iowait(struct disk *d, struct buf *b)
+{
+  uint t0;
+
+  if(b->disk == 0)
+    return;
+  d->niowait++;
+  t0 = ticks;
+  if(d->pollspin)
+    poll(d, b);
   while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+    sleep(b, &d->vdisk_lock);
   }
+  d->ioticks += ticks - t0;
+}
+
+// the disk that holds device dev's blocks.
+static struct disk*
+dsk(uint dev)
+{
+  return &disks[bdevsw[dev].unit];
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// start reading or writing b, and return without waiting.
+// if b->iodone is set, the interrupt handler calls it when
+// the request is done; otherwise call virtio_disk_wait(b).
+void
+virtio_disk_start(struct buf *b, int write)
+{
+  struct disk *d = dsk(b->dev);
 
-  release(&disk.vdisk_lock);
+  acquire(&d->vdisk_lock);
+  queue(d, &b, 1, write);
+  release(&d->vdisk_lock);
 }
 
+// start reading or writing bs[0..n-1], all for the same
+// device, and return without waiting.  completion is as for
+// virtio_disk_start(), for each buf.
 void
-virtio_disk_intr()
+virtio_disk_startv(struct buf **bs, int n, int write)
 {
-  acquire(&disk.vdisk_lock);
+  struct disk *d = dsk(bs[0]->dev);
+
+  acquire(&d->vdisk_lock);
+  queue(d, bs, n, write);
+  release(&d->vdisk_lock);
+}
 
-  while((disk.used_idx % NUM) != (disk.used->id % NUM)){
-    int id = disk.used->elems[disk.used_idx].id;
+// wait for a request started by virtio_disk_start() to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  struct disk *d = dsk(b->dev);
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+  acquire(&d->vdisk_lock);
+  iowait(d, b);
+  release(&d->vdisk_lock);
+}
 
-    disk.used_idx = (disk.used_idx + 1) % NUM;
+// turn polling on for every disk, checking the used ring
+// spin times before sleeping, or off if spin is 0.  returns
+// the old setting.
+int
+virtio_disk_poll(int spin)
+{
+  struct disk *d;
+  int old = 0;
+
+  for(d = disks; d < disks+NVIRTIO; d++){
+    if(d->dev == 0)
+      continue;
+    acquire(&d->vdisk_lock);
+    old = d->pollspin;
+    d->pollspin = spin;
+    release(&d->vdisk_lock);
   }
+  return old;
+}
+
+// interrupt from the disk in mmio slot i.
+void
+virtio_disk_intr(int i)
+{
+  struct disk *d = &disks[i];
+
+  if(d->dev == 0)
+    return;
+  acquire(&d->vdisk_lock);
+
+  d->nintr++;
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  complete(d);
+
+  release(&d->vdisk_lock);
+}
 
-  release(&disk.vdisk_lock);
+int
+statsdisk(char *buf, int sz)
+{
+  struct disk *d;
+  int n = 0;
+
+  for(d = disks; d < disks+NVIRTIO && sz - n > 512; d++){
+    if(d->dev == 0)
+      continue;
+    acquire(&d->vdisk_lock);
+    n += snprintf(buf+n, sz-n,
+                  "disk: dev %d queue %d requests %d blocks %d\n"
+                  "disk: depth %d avg %d max %d limit %d\n"
+                  "disk: elevator queued %d now %d max %d wait ticks %d\n"
+                  "disk: elevator requests %d merged %d expired %d\n"
+                  "disk: io waits %d ticks %d\n"
+                  "disk: interrupts %d notifies %d skipped %d event_idx %d\n"
+                  "disk: polls %d found %d timeouts %d\n",
+                  d->dev, d->num, d->nreq, d->nblock,
+                  d->depth, d->nreq ? d->depthsum / d->nreq : 0, d->maxdepth, d->qdepth,
+                  d->elv.nqueued, d->elv.n, d->elv.maxn, d->elv.waitticks,
+                  d->elv.nreq, d->elv.nmerged, d->elv.nexpired,
+                  d->niowait, d->ioticks,
+                  d->nintr, d->nnotify, d->nquiet, d->eventidx,
+                  d->npolls, d->npolled, d->npolltimeout);
+    release(&d->vdisk_lock);
+  }
+  return n;
 }
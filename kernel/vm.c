@@ -36,8 +36,8 @@ void vminit(pagetable_t pagetable)
   // uart registers
   vmmap(pagetable, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
-  // virtio mmio disk interface
-  vmmap(pagetable, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+  // virtio mmio disk interfaces
+  vmmap(pagetable, VIRTIO0, VIRTIO0, NVIRTIO*PGSIZE, PTE_R | PTE_W);
 
   // CLINT
   // vmmap(pagetable, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
@@ -54,6 +54,13 @@ void vminit(pagetable_t pagetable)
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   vmmap(pagetable, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
+
+#ifdef RAMDISK_ROOT
+  // the ramdisk image, in megapages, which every process's
+  // kernel page table can afford.
+  uint64 sz = ((uint64)FSSIZE*BSIZE + MEGAPGSIZE-1) & ~(MEGAPGSIZE-1);
+  vmmapmega(pagetable, RAMDISK, RAMDISK, sz, PTE_R | PTE_W);
+#endif
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -140,6 +147,35 @@ void vmmap(pagetable_t pagetable, uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
+// map [va, va+sz) to pa with level-1 leaf PTEs, each for
+// MEGAPGSIZE bytes, so that no level-0 page-table pages are
+// needed.  va, pa, and sz must be multiples of MEGAPGSIZE.
+// free_pagetable() leaves such mappings alone.
+void
+vmmapmega(pagetable_t pagetable, uint64 va, uint64 pa, uint64 sz, int perm)
+{
+  pte_t *pte;
+  pagetable_t l1;
+
+  if(va % MEGAPGSIZE || pa % MEGAPGSIZE || sz % MEGAPGSIZE)
+    panic("vmmapmega: alignment");
+  for(; sz > 0; va += MEGAPGSIZE, pa += MEGAPGSIZE, sz -= MEGAPGSIZE){
+    pte = &pagetable[PX(2, va)];
+    if(*pte & PTE_V){
+      l1 = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if((l1 = (pagetable_t)kalloc()) == 0)
+        panic("vmmapmega: kalloc");
+      memset(l1, 0, PGSIZE);
+      *pte = PA2PTE(l1) | PTE_V;
+    }
+    pte = &l1[PX(1, va)];
+    if(*pte & PTE_V)
+      panic("vmmapmega: remap");
+    *pte = PA2PTE(pa) | perm | PTE_V;
+  }
+}
+
 // translate a kernel virtual address to
 // a physical address. only needed for
 // addresses on the stack.
@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = FSSIZE/8 < LOGSIZE ? FSSIZE/8 : LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -31,6 +31,9 @@ struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
+struct dirent rootde[NDXENTRY*DPB/2];  // root directory's entries
+int nrootde;
+char leaves[NDXENTRY][BSIZE];
 
 
 void balloc(int);
@@ -40,6 +43,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void wdir(uint inum, struct dirent *de, int n);
 
 // convert to intel byte order
 ushort
@@ -68,10 +72,9 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  uint rootino, inum;
+  struct dirent *de;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
@@ -83,6 +86,9 @@ main(int argc, char *argv[])
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
+  assert(sizeof(struct dxentry) == sizeof(struct dirent));
+  assert(sizeof(struct dxroot) == BSIZE);
+  assert(sizeof(struct dxnode) == BSIZE);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
@@ -118,15 +124,13 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  de = &rootde[nrootde++];
+  de->inum = xshort(rootino);
+  strcpy(de->name, ".");
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  de = &rootde[nrootde++];
+  de->inum = xshort(rootino);
+  strcpy(de->name, "..");
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,10 +156,10 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    assert(nrootde < sizeof(rootde)/sizeof(rootde[0]));
+    de = &rootde[nrootde++];
+    de->inum = xshort(inum);
+    strncpy(de->name, shortname, DIRSIZ);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -163,12 +167,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  wdir(rootino, rootde, nrootde);
 
   balloc(freeblock);
 
@@ -260,6 +259,49 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the address of block fbn of din, allocating
+// blocks as needed, as bmap() in kernel/fs.c does.
+uint
+bmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint addr, span, i;
+  int level;
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(freeblock++);
+    }
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+
+  span = 1;
+  for(level = 1; level <= 3; level++){
+    if(fbn < span*NINDIRECT)
+      break;
+    fbn -= span*NINDIRECT;
+    span *= NINDIRECT;
+  }
+  assert(level <= 3);
+
+  if(xint(din->addrs[NDIRECT+level-1]) == 0){
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  }
+  addr = xint(din->addrs[NDIRECT+level-1]);
+  for(; span > 0; span /= NINDIRECT){
+    rsect(addr, (char*)indirect);
+    i = fbn / span;
+    fbn %= span;
+    if(indirect[i] == 0){
+      indirect[i] = xint(freeblock++);
+      wsect(addr, (char*)indirect);
+    }
+    addr = xint(indirect[i]);
+  }
+  return addr;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -267,7 +309,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -276,22 +317,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = bmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -303,3 +329,74 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Hash a directory entry name, as dirhash() in kernel/fs.c does.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  return h;
+}
+
+int
+dircmp(const void *a, const void *b)
+{
+  uint ha = dirhash(((struct dirent*)a)->name);
+  uint hb = dirhash(((struct dirent*)b)->name);
+
+  return ha < hb ? -1 : ha > hb;
+}
+
+// Write the n entries de[], the first two "." and "..", as the
+// contents of directory inum: a plain array of dirents if they
+// fit in a block, and otherwise an indexed directory with its
+// leaves half full, leaving room to grow.
+void
+wdir(uint inum, struct dirent *de, int n)
+{
+  struct dxroot r;
+  struct dinode din;
+  int i, j, k, nleaf;
+  uint h;
+
+  if(n <= DPB){
+    iappend(inum, de, n * sizeof(*de));
+    // The rest of the block is free entries.
+    rinode(inum, &din);
+    din.size = xint(BSIZE);
+    winode(inum, &din);
+    return;
+  }
+
+  // Sort by hash, and deal the entries out to leaves of
+  // about DPB/2, keeping names with the same hash together.
+  qsort(de + 2, n - 2, sizeof(*de), dircmp);
+  bzero(&r, sizeof(r));
+  r.dot = de[0];
+  r.dotdot = de[1];
+  nleaf = 0;
+  for(i = 2; i < n; i = j){
+    h = dirhash(de[i].name);
+    for(j = i + 1; j < n && (j - i < DPB/2 || dirhash(de[j].name) == dirhash(de[j-1].name)); j++)
+      ;
+    assert(nleaf < NDXENTRY && j - i <= DPB);
+    r.e[nleaf].hash = xint(nleaf == 0 ? 0 : h);
+    r.e[nleaf].block = xint(nleaf + 1);
+    for(k = i; k < j; k++)
+      ((struct dirent*)leaves[nleaf])[k - i] = de[k];
+    nleaf++;
+  }
+  r.n = xshort(nleaf);
+
+  iappend(inum, &r, BSIZE);
+  for(i = 0; i < nleaf; i++)
+    iappend(inum, leaves[i], BSIZE);
+  rinode(inum, &din);
+  din.flags = xint(xint(din.flags) | I_INDEX);
+  winode(inum, &din);
+}
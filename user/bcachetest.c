@@ -0,0 +1,191 @@
+//
+// Buffer cache benchmark and stress test.
+//
+// test0 has several processes read their own small files one byte
+// at a time, so that nearly every read() is a buffer cache hit,
+// and reports how often the bcache bucket locks were contended.
+// test1 has several processes write and check files that together
+// are larger than the cache, to exercise eviction.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define SZ 4096
+char buf[SZ];
+
+// Return the bcache bucket lock "#test-and-set" count
+// from the fsstats device, optionally printing the
+// bcache lines.
+int
+ntas(int print)
+{
+  char *key = "#test-and-set ";
+  char *p, *e;
+  int n, k;
+
+  n = fsstatistics(buf, SZ-16);
+  if(n <= 0){
+    fprintf(2, "ntas: no stats\n");
+    exit(1);
+  }
+  memset(buf+n, 0, 16);
+  if(print){
+    for(p = buf; *p; p = e){
+      for(e = p; *e && *e != '\n'; e++)
+        ;
+      if(*e)
+        e++;
+      if(memcmp(p, "bcache:", 7) == 0)
+        write(1, p, e - p);
+    }
+  }
+  k = strlen(key);
+  for(p = buf; *p; p++){
+    if(memcmp(p, key, k) == 0)
+      return atoi(p+k);
+  }
+  fprintf(2, "ntas: no bcache lock counters\n");
+  exit(1);
+}
+
+void
+createfile(char *file, int nblock)
+{
+  char blk[BSIZE];
+  int fd, i;
+
+  fd = open(file, O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("createfile %s failed\n", file);
+    exit(1);
+  }
+  for(i = 0; i < nblock; i++){
+    memset(blk, 'a' + i % 26, BSIZE);
+    if(write(fd, blk, BSIZE) != BSIZE){
+      printf("write %s failed\n", file);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// Read file inc bytes at a time, checking that
+// block i is filled with 'a' + i % 26.
+void
+readfile(char *file, int nblock, int inc)
+{
+  char blk[BSIZE];
+  int fd, off, n;
+
+  if(inc > BSIZE){
+    printf("readfile: inc too large\n");
+    exit(1);
+  }
+  if((fd = open(file, O_RDONLY)) < 0){
+    printf("open %s failed\n", file);
+    exit(1);
+  }
+  for(off = 0; off < nblock*BSIZE; off += n){
+    if((n = read(fd, blk, inc)) != inc){
+      printf("read %s failed for block %d\n", file, off / BSIZE);
+      exit(1);
+    }
+    if(blk[0] != 'a' + (off / BSIZE) % 26 || blk[n-1] != blk[0]){
+      printf("%s: wrong content in block %d\n", file, off / BSIZE);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+test0(void)
+{
+  enum { N = NBUF / 4, NCHILD = 3 };
+  char file[] = "bc0";
+  int i, m, n, pid, xstatus;
+
+  printf("start test0\n");
+  for(i = 0; i < NCHILD; i++){
+    file[2] = '0' + i;
+    unlink(file);
+    createfile(file, N);
+  }
+
+  m = ntas(0);
+  for(i = 0; i < NCHILD; i++){
+    file[2] = '0' + i;
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      readfile(file, N, 1);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  printf("test0 results:\n");
+  n = ntas(1);
+  for(i = 0; i < NCHILD; i++){
+    file[2] = '0' + i;
+    unlink(file);
+  }
+  printf("test0: bucket lock contention %d\n", n - m);
+  if(n - m < 500)
+    printf("test0: OK\n");
+  else
+    printf("test0: FAIL\n");
+}
+
+void
+test1(void)
+{
+  enum { N = NBUF, NCHILD = 4, ROUNDS = 2 };
+  char file[] = "bc1";
+  int i, r, pid, xstatus;
+
+  printf("start test1\n");
+  for(i = 0; i < NCHILD; i++){
+    file[2] = '0' + i;
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      unlink(file);
+      createfile(file, N);
+      for(r = 0; r < ROUNDS; r++)
+        readfile(file, N, BSIZE);
+      unlink(file);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("test1: FAIL\n");
+      exit(xstatus);
+    }
+  }
+  printf("test1: OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  test0();
+  test1();
+  exit(0);
+}
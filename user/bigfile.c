@@ -0,0 +1,101 @@
+//
+// Write a big file, read it back, and report how fast.
+//
+//   bigfile [-b] [MiB]
+//
+// The file maps its blocks by extents, unless -b asks for a
+// block-mapped one (fsetmap(FM_BLOCKS)).  Then the default, 64 MiB,
+// needs doubly-indirect blocks, and more than
+// NDIRECT+NINDIRECT+NDINDIRECT blocks (about 64.3 MiB) need
+// the triply-indirect block too.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define CHUNK 16   // blocks per write() and read()
+
+char buf[CHUNK*BSIZE];
+
+void
+report(char *what, int nblock, int ticks)
+{
+  printf("bigfile: %s %d blocks in %d ticks", what, nblock, ticks);
+  if(ticks > 0)
+    printf(", %d KiB/tick", nblock * (BSIZE/1024) / ticks);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, j, nblock, n, t0, map;
+  char *file = "big.file";
+
+  map = FM_EXTENTS;
+  if(argc > 1 && strcmp(argv[1], "-b") == 0){
+    map = FM_BLOCKS;
+    argc--;
+    argv++;
+  }
+  nblock = 64 * 1024;
+  if(argc > 1)
+    nblock = atoi(argv[1]) * (1024*1024 / BSIZE);
+  if(nblock <= 0 || nblock % CHUNK != 0){
+    fprintf(2, "usage: bigfile [-b] [MiB]\n");
+    exit(1);
+  }
+
+  unlink(file);
+  fd = open(file, O_CREATE | O_WRONLY);
+  if(fd < 0 || fsetmap(fd, map) < 0){
+    printf("bigfile: cannot open %s for writing\n", file);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < nblock; i += CHUNK){
+    for(j = 0; j < CHUNK; j++)
+      *(int*)(buf + j*BSIZE) = i + j;
+    if((n = write(fd, buf, sizeof(buf))) != sizeof(buf)){
+      printf("bigfile: write returned %d at block %d\n", n, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  report("wrote", nblock, uptime() - t0);
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0){
+    printf("bigfile: cannot re-open %s for reading\n", file);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < nblock; i += CHUNK){
+    if((n = read(fd, buf, sizeof(buf))) != sizeof(buf)){
+      printf("bigfile: read returned %d at block %d\n", n, i);
+      exit(1);
+    }
+    for(j = 0; j < CHUNK; j++){
+      if(*(int*)(buf + j*BSIZE) != i + j){
+        printf("bigfile: wrong content in block %d\n", i + j);
+        exit(1);
+      }
+    }
+  }
+  if(read(fd, buf, BSIZE) != 0){
+    printf("bigfile: file is too long\n");
+    exit(1);
+  }
+  close(fd);
+  report("read", nblock, uptime() - t0);
+
+  if(unlink(file) < 0){
+    printf("bigfile: unlink %s failed\n", file);
+    exit(1);
+  }
+  printf("bigfile: OK\n");
+  exit(0);
+}
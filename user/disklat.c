@@ -0,0 +1,177 @@
+//
+// Compare interrupt-driven and polled completion of small
+// synchronous disk reads.
+//
+//   disklat [nproc [spin]]
+//
+// Writes a file too big for the buffer cache, then has nproc
+// processes (default 1 and 4) each pread() single blocks at
+// random offsets, first with polling off and then with
+// diskpoll(spin) (default 100000).  Reports the ticks taken,
+// the disk reads per tick, ticks per thousand disk reads, and
+// the disk's interrupts and polls, as counted by the fsstats
+// device.  With one process the disk reads per tick measure
+// latency; with more, throughput.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NBLOCK (16*1024)   // 16 MiB, four times the largest buffer cache
+#define NREAD 2000         // reads per process
+#define SPIN 100000
+
+char stats[4096];
+char buf[16*BSIZE];
+char *file = "disklat.tmp";
+
+// Return a pointer just past the first key at or after p.
+char*
+skip(char *p, char *key)
+{
+  int k;
+
+  k = strlen(key);
+  for(; *p; p++){
+    if(memcmp(p, key, k) == 0)
+      return p+k;
+  }
+  fprintf(2, "disklat: no %s in stats\n", key);
+  exit(1);
+}
+
+#define NSTAT 4
+
+// Read the disk reads, interrupts, polls and requests found
+// by polling from the fsstats device.
+void
+fsstats(int *v)
+{
+  char *p;
+  int n;
+
+  n = fsstatistics(stats, sizeof(stats)-16);
+  if(n <= 0){
+    fprintf(2, "disklat: no stats\n");
+    exit(1);
+  }
+  memset(stats+n, 0, 16);
+  p = skip(stats, "bcache: disk reads ");
+  v[0] = atoi(p);
+  p = skip(stats, "disk: interrupts ");
+  v[1] = atoi(p);
+  p = skip(p, "disk: polls ");
+  v[2] = atoi(p);
+  p = skip(p, " found ");
+  v[3] = atoi(p);
+}
+
+void
+fail(char *what)
+{
+  printf("disklat: %s failed\n", what);
+  exit(1);
+}
+
+void
+mkfile(void)
+{
+  int fd, i;
+
+  unlink(file);
+  if((fd = open(file, O_CREATE | O_WRONLY)) < 0)
+    fail("create");
+  memset(buf, 'd', sizeof(buf));
+  for(i = 0; i < NBLOCK; i += 16){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+}
+
+// Read NREAD random blocks, one at a time.
+void
+reader(int id)
+{
+  int fd, i;
+  uint x;
+
+  if((fd = open(file, O_RDONLY)) < 0)
+    fail("open");
+  x = 12345 + id * 7919;
+  for(i = 0; i < NREAD; i++){
+    x = x * 1103515245 + 12345;
+    if(pread(fd, buf, BSIZE, (x >> 8) % NBLOCK * BSIZE) != BSIZE)
+      fail("pread");
+  }
+  close(fd);
+}
+
+void
+run(char *mode, int nproc, int spin)
+{
+  int i, pid, xstatus, t0, ticks, n;
+  int v0[NSTAT], v[NSTAT];
+
+  diskpoll(spin);
+  fsstats(v0);
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      reader(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < nproc; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  ticks = uptime() - t0;
+  fsstats(v);
+  diskpoll(0);
+
+  n = v[0] - v0[0];
+  printf("disklat: %s, %d procs: %d reads, %d from disk, in %d ticks",
+         mode, nproc, nproc*NREAD, n, ticks);
+  if(ticks > 0)
+    printf(", %d disk reads/tick", n / ticks);
+  if(n > 0)
+    printf(", %d ticks/1000 disk reads", ticks * 1000 / n);
+  printf("\n");
+  printf("disklat: %s, %d procs: %d interrupts, %d polls found %d requests\n",
+         mode, nproc, v[1] - v0[1], v[2] - v0[2], v[3] - v0[3]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = 0, spin = SPIN;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    spin = atoi(argv[2]);
+  if(nproc < 0 || nproc > 26 || spin <= 0){
+    fprintf(2, "usage: disklat [nproc [spin]]\n");
+    exit(1);
+  }
+
+  mkfile();
+  if(nproc == 0){
+    run("interrupt", 1, 0);
+    run("poll", 1, spin);
+    run("interrupt", 4, 0);
+    run("poll", 4, spin);
+  } else {
+    run("interrupt", nproc, 0);
+    run("poll", nproc, spin);
+  }
+  unlink(file);
+  exit(0);
+}
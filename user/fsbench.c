@@ -0,0 +1,310 @@
+//
+// File system benchmark.
+//
+//   fsbench [test [nproc]]
+//
+// runs test in nproc processes at once (default 4), and
+// reports the elapsed ticks, the rate, how the file
+// system's work was spread over log commits, how often
+// the directory entry cache answered lookups, and how many
+// blocks each block map lookup found (more when files are
+// contiguous on disk), as counted by the fsstats device.  With no test, runs
+// them all.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NITER 50
+#define RCHUNK 10   // blocks per read() in append
+
+char stats[4096];
+char rbuf[RCHUNK*BSIZE];
+
+// Return a pointer just past the first key at or after p.
+char*
+skip(char *p, char *key)
+{
+  int k;
+
+  k = strlen(key);
+  for(; *p; p++){
+    if(memcmp(p, key, k) == 0)
+      return p+k;
+  }
+  fprintf(2, "fsbench: no %s in stats\n", key);
+  exit(1);
+}
+
+#define NSTAT 11
+
+// Read counters from the fsstats device: the log's commits,
+// file system operations, blocks logged, checkpoints, blocks
+// installed and installs absorbed, then the dcache's hits,
+// negative hits and misses, then block map lookups and the
+// blocks they found.
+void
+fsstats(int *v)
+{
+  char *p;
+  int n;
+
+  n = fsstatistics(stats, sizeof(stats)-16);
+  if(n <= 0){
+    fprintf(2, "fsbench: no stats\n");
+    exit(1);
+  }
+  memset(stats+n, 0, 16);
+  p = skip(stats, "log: commits ");
+  v[0] = atoi(p);
+  p = skip(p, " ops ");
+  v[1] = atoi(p);
+  p = skip(p, " blocks ");
+  v[2] = atoi(p);
+  p = skip(p, "log: checkpoints ");
+  v[3] = atoi(p);
+  p = skip(p, " installed ");
+  v[4] = atoi(p);
+  p = skip(p, " absorbed ");
+  v[5] = atoi(p);
+  p = skip(p, "dcache: hit ");
+  v[6] = atoi(p);
+  p = skip(p, " negative ");
+  v[7] = atoi(p);
+  p = skip(p, " miss ");
+  v[8] = atoi(p);
+  p = skip(p, "bmap: lookups ");
+  v[9] = atoi(p);
+  p = skip(p, " blocks ");
+  v[10] = atoi(p);
+}
+
+void
+fail(char *what, char *file)
+{
+  printf("fsbench: %s %s failed\n", what, file);
+  exit(1);
+}
+
+// Create, write a block to, and unlink NITER small files,
+// like usertests' createdelete.
+void
+createdelete(int id)
+{
+  char file[8], blk[BSIZE];
+  int i, fd;
+
+  memset(blk, 'c', BSIZE);
+  file[0] = 'c';
+  file[1] = 'a' + id;
+  file[3] = 0;
+  for(i = 0; i < NITER; i++){
+    file[2] = 'a' + i % 26;
+    if((fd = open(file, O_CREATE | O_RDWR)) < 0)
+      fail("create", file);
+    if(write(fd, blk, BSIZE) != BSIZE)
+      fail("write", file);
+    close(fd);
+    if(unlink(file) < 0)
+      fail("unlink", file);
+  }
+}
+
+// Append NITER blocks to a private file, like usertests'
+// fourfiles, read them back RCHUNK at a time, then remove it.
+void
+append(int id)
+{
+  char file[8], blk[BSIZE];
+  int i, fd;
+
+  memset(blk, 'a', BSIZE);
+  file[0] = 'a';
+  file[1] = 'a' + id;
+  file[2] = 0;
+  if((fd = open(file, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+    fail("create", file);
+  for(i = 0; i < NITER; i++){
+    if(write(fd, blk, BSIZE) != BSIZE)
+      fail("write", file);
+  }
+  close(fd);
+  if((fd = open(file, O_RDONLY)) < 0)
+    fail("open", file);
+  for(i = 0; i < NITER; i += RCHUNK){
+    if(read(fd, rbuf, RCHUNK*BSIZE) != RCHUNK*BSIZE)
+      fail("read", file);
+  }
+  close(fd);
+  unlink(file);
+}
+
+// Append NITER blocks to a private file a sixteenth of a
+// block at a time, like a log file, then remove it.
+void
+smallappend(int id)
+{
+  char file[8], buf[BSIZE/16];
+  int i, fd;
+
+  memset(buf, 's', sizeof(buf));
+  file[0] = 's';
+  file[1] = 'a' + id;
+  file[2] = 0;
+  if((fd = open(file, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+    fail("create", file);
+  for(i = 0; i < 16*NITER; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write", file);
+  }
+  close(fd);
+  unlink(file);
+}
+
+// Link a file to NITER names, like usertests' bigdir,
+// then look each one up, and unlink them.
+void
+bigdir(int id)
+{
+  char file[8], name[8];
+  int i, fd;
+
+  file[0] = 'b';
+  file[1] = 'a' + id;
+  file[2] = 0;
+  if((fd = open(file, O_CREATE | O_RDWR)) < 0)
+    fail("create", file);
+  close(fd);
+  name[0] = 'x';
+  name[1] = 'a' + id;
+  name[4] = 0;
+  for(i = 0; i < NITER; i++){
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    if(link(file, name) < 0)
+      fail("link", name);
+  }
+  for(i = 0; i < NITER; i++){
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    if((fd = open(name, O_RDONLY)) < 0)
+      fail("open", name);
+    close(fd);
+  }
+  for(i = 0; i < NITER; i++){
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    if(unlink(name) < 0)
+      fail("unlink", name);
+  }
+  unlink(file);
+}
+
+// Create and unlink a few names shared by all the
+// processes, like usertests' concreate.
+void
+concreate(int id)
+{
+  char file[4];
+  int i, fd;
+
+  file[0] = 'C';
+  file[2] = 0;
+  for(i = 0; i < NITER; i++){
+    file[1] = '0' + i % 20;
+    if((i + id) % 3 == 0){
+      unlink(file);
+    } else {
+      if((fd = open(file, O_CREATE | O_RDWR)) < 0)
+        fail("create", file);
+      close(fd);
+    }
+  }
+  for(i = 0; i < 20; i++){
+    file[1] = '0' + i;
+    unlink(file);
+  }
+}
+
+struct test {
+  void (*f)(int);
+  char *s;
+  int nops;   // system calls per process
+} tests[] = {
+  {createdelete, "createdelete", 3*NITER},
+  {append, "append", NITER + NITER/RCHUNK},
+  {smallappend, "smallappend", 16*NITER},
+  {bigdir, "bigdir", 3*NITER},
+  {concreate, "concreate", NITER+20},
+  { 0, 0, 0},
+};
+
+void
+run(struct test *t, int nproc)
+{
+  int i, pid, xstatus, nops, t0, ticks;
+  int v0[NSTAT], v[NSTAT], c;
+
+  fsstats(v0);
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if((pid = fork()) < 0)
+      fail("fork", t->s);
+    if(pid == 0){
+      t->f(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < nproc; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  ticks = uptime() - t0;
+  fsstats(v);
+  nops = nproc * t->nops;
+  c = v[0] - v0[0];
+
+  printf("%s: %d procs, %d ops in %d ticks", t->s, nproc, nops, ticks);
+  if(ticks > 0)
+    printf(", %d ops/tick", nops / ticks);
+  printf("\n");
+  printf("%s: %d commits, %d fs ops/commit, %d blocks/commit\n", t->s, c,
+         c ? (v[1] - v0[1]) / c : 0, c ? (v[2] - v0[2]) / c : 0);
+  printf("%s: %d checkpoints, %d blocks installed, %d absorbed\n", t->s,
+         v[3] - v0[3], v[4] - v0[4], v[5] - v0[5]);
+  printf("%s: dcache %d hits, %d negative, %d misses\n", t->s,
+         v[6] - v0[6], v[7] - v0[7], v[8] - v0[8]);
+  c = v[9] - v0[9];
+  printf("%s: %d block map lookups, %d blocks/lookup\n", t->s, c,
+         c ? (v[10] - v0[10]) / c : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct test *t;
+  int nproc = 4, found = 0;
+
+  if(argc > 2)
+    nproc = atoi(argv[2]);
+  if(nproc < 1 || nproc > 26){
+    fprintf(2, "usage: fsbench [test [nproc]]\n");
+    exit(1);
+  }
+  for(t = tests; t->s != 0; t++){
+    if(argc < 2 || strcmp(argv[1], t->s) == 0){
+      run(t, nproc);
+      found = 1;
+    }
+  }
+  if(!found){
+    fprintf(2, "fsbench: no test %s\n", argv[1]);
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,17 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc != 3){
+    fprintf(2, "Usage: mount dev dir\n");
+    exit(1);
+  }
+  if(mount(atoi(argv[1]), argv[2]) < 0){
+    fprintf(2, "mount %s %s: failed\n", argv[1], argv[2]);
+    exit(1);
+  }
+  exit(0);
+}
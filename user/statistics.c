@@ -3,14 +3,14 @@
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
-int
-statistics(void *buf, int sz)
+static int
+readstats(char *path, void *buf, int sz)
 {
   int fd, i, n;
   
-  fd = open("statistics", O_RDONLY);
+  fd = open(path, O_RDONLY);
   if(fd < 0) {
-      fprintf(2, "stats: open failed\n");
+      fprintf(2, "stats: open %s failed\n", path);
       exit(1);
   }
   for (i = 0; i < sz; ) {
@@ -22,3 +22,16 @@ statistics(void *buf, int sz)
   close(fd);
   return i;
 }
+
+int
+statistics(void *buf, int sz)
+{
+  return readstats("statistics", buf, sz);
+}
+
+// File system and disk counters, from the fsstats device.
+int
+fsstatistics(void *buf, int sz)
+{
+  return readstats("fsstats", buf, sz);
+}
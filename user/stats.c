@@ -7,12 +7,13 @@
 char buf[SZ];
 
 int
-main(void)
+main(int argc, char *argv[])
 {
   int i, n;
+  int fs = argc > 1 && strcmp(argv[1], "fs") == 0;
   
   while (1) {
-    n = statistics(buf, SZ);
+    n = fs ? fsstatistics(buf, SZ) : statistics(buf, SZ);
     for (i = 0; i < n; i++) {
       write(1, buf+i, 1);
     }
@@ -1,4 +1,6 @@
 struct stat;
+struct dirstat;
+struct iovec;
 struct rtcdate;
 struct sysinfo;
 
@@ -24,6 +26,17 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int getdents(int, struct dirstat*, int, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, int);
+int fsync(int);
+int fallocate(int, int, int);
+int diskpoll(int);
+int mount(int, char*);
+int fsetmap(int, int);
 #ifdef LAB_NET
 int connect(uint32, uint16, uint16);
 #endif
@@ -45,3 +58,4 @@ int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 int statistics(void*, int);
+int fsstatistics(void*, int);
@@ -4,6 +4,7 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -523,18 +524,23 @@ writetest(char *s)
   }
 }
 
+// a file reaching into the doubly-indirect blocks; MAXFILE
+// itself is more than the disk holds.  New files map their
+// blocks by extents, so ask for indirect blocks with fsetmap().
+#define NBIG (NDIRECT + NINDIRECT + 2*NINDIRECT)
+
 void
 writebig(char *s)
 {
   int i, fd, n;
 
-  fd = open("big", O_CREATE|O_RDWR);
-  if(fd < 0){
+  fd = open("big", O_CREATE|O_RDWR|O_TRUNC);
+  if(fd < 0 || fsetmap(fd, FM_BLOCKS) < 0){
     printf("%s: error: creat big failed!\n", s);
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", i);
@@ -554,7 +560,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", n);
         exit(1);
       }
@@ -1479,6 +1485,924 @@ bigdir(char *s)
   }
 }
 
+// A directory with more entries than one full index root
+// lists: its leaves are split until the root is full and the
+// index grows a level.  Each name must still be found.
+void
+bigindex(char *s)
+{
+  enum { N = 6000 };
+  int i, fd;
+  char name[8];
+  struct stat st;
+
+  if(mkdir("bix") != 0){
+    printf("%s: mkdir bix failed\n", s);
+    exit(1);
+  }
+  if(chdir("bix") != 0){
+    printf("%s: chdir bix failed\n", s);
+    exit(1);
+  }
+  if((fd = open("f", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create bix/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  name[0] = 'x';
+  name[5] = '\0';
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i / 1000;
+    name[2] = '0' + i / 100 % 10;
+    name[3] = '0' + i / 10 % 10;
+    name[4] = '0' + i % 10;
+    if(link("f", name) < 0){
+      printf("%s: link(bix/f, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(stat("f", &st) < 0 || st.nlink != N+1){
+    printf("%s: bix/f has the wrong link count\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i / 1000;
+    name[2] = '0' + i / 100 % 10;
+    name[3] = '0' + i / 10 % 10;
+    name[4] = '0' + i % 10;
+    if(unlink(name) != 0){
+      printf("%s: unlink bix/%s failed\n", s, name);
+      exit(1);
+    }
+  }
+  unlink("f");
+  chdir("..");
+  if(unlink("bix") != 0){
+    printf("%s: unlink bix failed\n", s);
+    exit(1);
+  }
+}
+
+// pread() and pwrite() use their own offset, not the file's,
+// and readv() and writev() fill and drain several buffers.
+void
+preadwrite(char *s)
+{
+  char a[8], b[8], c[BSIZE];
+  struct iovec iov[3];
+  int fd, i;
+
+  unlink("prw");
+  if((fd = open("prw", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create prw failed\n", s);
+    exit(1);
+  }
+
+  // writev "abc", a block of 'x', and "defgh".
+  memset(c, 'x', sizeof(c));
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = c;
+  iov[1].iov_len = sizeof(c);
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 3 + sizeof(c) + 5){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+
+  // lengths that add up to more than an int holds.
+  iov[0].iov_len = 0x7fffffff;
+  iov[1].iov_len = 2;
+  if(writev(fd, iov, 2) != -1 || readv(fd, iov, 2) != -1){
+    printf("%s: readv or writev of more than 2^31-1 bytes succeeded\n", s);
+    exit(1);
+  }
+
+  if(pwrite(fd, "XY", 2, 1) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "ij", 2) != 2){
+    printf("%s: write after pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 0) != 4 || memcmp(a, "aXYx", 4) != 0){
+    printf("%s: pread got wrong data\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 8, 3 + sizeof(c)) != 7 || memcmp(a, "defghij", 7) != 0){
+    printf("%s: pread at the end got wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if((fd = open("prw", O_RDONLY)) < 0){
+    printf("%s: open prw failed\n", s);
+    exit(1);
+  }
+  memset(c, 0, sizeof(c));
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = c;
+  iov[1].iov_len = sizeof(c);
+  iov[2].iov_base = b;
+  iov[2].iov_len = sizeof(b);
+  if(readv(fd, iov, 3) != 3 + sizeof(c) + 7){
+    printf("%s: readv returned the wrong count\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(c); i++){
+    if(c[i] != 'x'){
+      printf("%s: readv got wrong data\n", s);
+      exit(1);
+    }
+  }
+  if(memcmp(a, "aXY", 3) != 0 || memcmp(b, "defghij", 7) != 0){
+    printf("%s: readv got wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("prw");
+}
+
+// sendfile() copies a file to a file and to a pipe.
+void
+sendfiletest(char *s)
+{
+  enum { N = 3*BSIZE + 100 };
+  char c;
+  int fd, fd1, i, n, fds[2], pid, xstatus;
+
+  unlink("sf0");
+  unlink("sf1");
+  if((fd = open("sf0", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create sf0 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    c = 'a' + i % 23;
+    if(write(fd, &c, 1) != 1){
+      printf("%s: write sf0 failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("sf0", O_RDONLY);
+  fd1 = open("sf1", O_CREATE | O_RDWR);
+  if(fd < 0 || fd1 < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if((n = sendfile(fd1, fd, N + 10)) != N || sendfile(fd1, fd, 10) != 0){
+    printf("%s: sendfile to a file returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+  close(fd1);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    fd = open("sf1", O_RDONLY);
+    if(sendfile(fds[1], fd, N) != N)
+      exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  for(i = 0; read(fds[0], &c, 1) == 1; i++){
+    if(c != 'a' + i % 23){
+      printf("%s: sendfile copied wrong data\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0 || i != N){
+    printf("%s: sendfile to a pipe failed\n", s);
+    exit(1);
+  }
+  unlink("sf0");
+  unlink("sf1");
+}
+
+// The number after field on the fsstats device's line that
+// starts with line, such as the count of bitmap words in which
+// the allocator passed over blocks freed by the open
+// transaction: fsstatcount(s, "balloc: ", " freed ").
+int
+fsstatcount(char *s, char *line, char *field)
+{
+  static char st[4096];
+  char *p;
+  int n;
+
+  if((n = fsstatistics(st, sizeof(st)-1)) <= 0){
+    printf("%s: fsstatistics failed\n", s);
+    exit(1);
+  }
+  st[n] = 0;
+  for(p = st; *p; p++){
+    if(memcmp(p, line, strlen(line)) == 0)
+      break;
+  }
+  for(; *p && *p != '\n'; p++){
+    if(memcmp(p, field, strlen(field)) == 0)
+      return atoi(p + strlen(field));
+  }
+  printf("%s: no%s count in fsstats\n", s, field);
+  exit(1);
+}
+
+// A block freed by a transaction that has not committed yet is
+// not handed out again: here truncating a block-mapped file
+// frees its indirect block, which must not turn into another
+// file's data while the inode that points at it is still on
+// disk.  A second process keeps writing so that transactions
+// stay open across the truncate and the writes after it.
+void
+freereuse(char *s)
+{
+  int fd, i, j, k, pid, xstatus, n0;
+
+  n0 = fsstatcount(s, "balloc: ", " freed ");
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    memset(buf, 'b', BSIZE);
+    for(i = 0; i < 40; i++){
+      if((fd = open("frbusy", O_CREATE | O_TRUNC | O_RDWR)) < 0)
+        exit(1);
+      for(j = 0; j < 20; j++){
+        if(write(fd, buf, BSIZE) != BSIZE)
+          exit(1);
+      }
+      close(fd);
+    }
+    exit(0);
+  }
+
+  for(i = 0; i < 20; i++){
+    unlink("frmeta");
+    if((fd = open("frmeta", O_CREATE | O_RDWR)) < 0 || fsetmap(fd, FM_BLOCKS) < 0){
+      printf("%s: create frmeta failed\n", s);
+      exit(1);
+    }
+    memset(buf, 'm', BSIZE);
+    for(j = 0; j < NDIRECT + 4; j++){
+      if(write(fd, buf, BSIZE) != BSIZE){
+        printf("%s: write frmeta failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+    // Truncating frees the indirect block.
+    if((fd = open("frmeta", O_RDWR | O_TRUNC)) < 0){
+      printf("%s: truncate frmeta failed\n", s);
+      exit(1);
+    }
+    close(fd);
+
+    unlink("frdata");
+    if((fd = open("frdata", O_CREATE | O_RDWR)) < 0){
+      printf("%s: create frdata failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NDIRECT + 4; j++){
+      memset(buf, 'a' + (i + j) % 26, BSIZE);
+      if(write(fd, buf, BSIZE) != BSIZE){
+        printf("%s: write frdata failed\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+    if((fd = open("frdata", O_RDONLY)) < 0){
+      printf("%s: open frdata failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NDIRECT + 4; j++){
+      if(read(fd, buf, BSIZE) != BSIZE){
+        printf("%s: read frdata failed\n", s);
+        exit(1);
+      }
+      for(k = 0; k < BSIZE; k++){
+        if(buf[k] != 'a' + (i + j) % 26){
+          printf("%s: wrong data in frdata\n", s);
+          exit(1);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: writer failed\n", s);
+    exit(1);
+  }
+  unlink("frmeta");
+  unlink("frdata");
+  unlink("frbusy");
+  if(fsstatcount(s, "balloc: ", " freed ") == n0){
+    printf("%s: no freed block was ever passed over\n", s);
+    exit(1);
+  }
+}
+
+// fsetmap() changes how a file maps its blocks only while it
+// is empty and open for writing.
+void
+setmap(char *s)
+{
+  int fd, fd1;
+  char c;
+
+  unlink("setmap");
+  if((fd = open("setmap", O_CREATE | O_RDWR)) < 0 ||
+     (fd1 = open("setmap", O_RDONLY)) < 0){
+    printf("%s: create setmap failed\n", s);
+    exit(1);
+  }
+  if(fsetmap(fd1, FM_BLOCKS) == 0){
+    printf("%s: fsetmap of a read-only descriptor succeeded\n", s);
+    exit(1);
+  }
+  if(fsetmap(fd, 2) == 0){
+    printf("%s: fsetmap to a bad format succeeded\n", s);
+    exit(1);
+  }
+  if(fsetmap(fd, FM_BLOCKS) != 0 || fsetmap(fd, FM_EXTENTS) != 0 ||
+     fsetmap(fd, FM_BLOCKS) != 0){
+    printf("%s: fsetmap of an empty file failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1){
+    printf("%s: write setmap failed\n", s);
+    exit(1);
+  }
+  if(fsetmap(fd, FM_EXTENTS) == 0){
+    printf("%s: fsetmap of a non-empty file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd1);
+  if((fd = open("setmap", O_RDONLY)) < 0 || read(fd, &c, 1) != 1 || c != 'x'){
+    printf("%s: setmap lost its data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("setmap");
+}
+
+// Small appends wait in memory for their disk blocks, so
+// reads through another descriptor, fstat(), fsync() and
+// a reopen must all find them there or on disk.
+void
+delalloc(char *s)
+{
+  char a[70], b[70];
+  struct stat st;
+  int fd, fd1, i, j;
+
+  unlink("delalloc");
+  if((fd = open("delalloc", O_CREATE | O_WRONLY)) < 0 ||
+     (fd1 = open("delalloc", O_RDONLY)) < 0){
+    printf("%s: create delalloc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++){
+    memset(a, 'a' + i % 26, sizeof(a));
+    if(write(fd, a, sizeof(a)) != sizeof(a)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    if(read(fd1, b, sizeof(b)) != sizeof(b) || memcmp(a, b, sizeof(a)) != 0){
+      printf("%s: read of fresh data failed\n", s);
+      exit(1);
+    }
+    if(i == 50 && fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+  }
+  if(fstat(fd, &st) < 0 || st.size != 100 * sizeof(a)){
+    printf("%s: wrong size\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd1);
+
+  if((fd = open("delalloc", O_RDONLY)) < 0){
+    printf("%s: open delalloc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++){
+    if(read(fd, b, sizeof(b)) != sizeof(b)){
+      printf("%s: short read\n", s);
+      exit(1);
+    }
+    for(j = 0; j < sizeof(b); j++){
+      if(b[j] != 'a' + i % 26){
+        printf("%s: wrong data after reopen\n", s);
+        exit(1);
+      }
+    }
+  }
+  if(read(fd, b, 1) != 0){
+    printf("%s: file too long\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("delalloc");
+}
+
+// Delayed data of a file that is left open and idle is
+// written by the kernel's flusher, and is still there to read.
+void
+delaysweep(char *s)
+{
+  char a[100], b[100];
+  int fd, n0;
+
+  unlink("dsweep");
+  if((fd = open("dsweep", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create dsweep failed\n", s);
+    exit(1);
+  }
+  n0 = fsstatcount(s, "delalloc: ", " swept ");
+  memset(a, 'w', sizeof(a));
+  if(write(fd, a, sizeof(a)) != sizeof(a)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  sleep(100);
+  if(fsstatcount(s, "delalloc: ", " swept ") == n0){
+    printf("%s: idle delayed data was not flushed\n", s);
+    exit(1);
+  }
+  if(read(fd, b, 1) != 0 || pread(fd, b, sizeof(b), 0) != sizeof(b) ||
+     memcmp(a, b, sizeof(a)) != 0){
+    printf("%s: wrong data after the flush\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("dsweep");
+}
+
+// fallocate() reserves blocks without changing the file's
+// size; writes then use them.  Only writable descriptors of
+// files mapped by extents accept it, and a range that cannot
+// all be reserved fails.
+void
+fallocatetest(char *s)
+{
+  char blk[BSIZE];
+  struct stat st;
+  int fd, i, fds[2];
+
+  unlink("falloc");
+  if((fd = open("falloc", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create falloc failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, 40*BSIZE) != 0){
+    printf("%s: fallocate failed\n", s);
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != 0){
+    printf("%s: fallocate changed the size\n", s);
+    exit(1);
+  }
+  if(read(fd, blk, 1) != 0){
+    printf("%s: read past the end\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 50; i++){
+    memset(blk, 'a' + i % 26, sizeof(blk));
+    if(write(fd, blk, 100) != 100){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  if(fallocate(fd, 4*BSIZE, BSIZE) != 0){
+    printf("%s: fallocate of held blocks failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, 0x7fffffff) != -1){
+    printf("%s: fallocate of more than the disk succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if((fd = open("falloc", O_RDONLY)) < 0){
+    printf("%s: open falloc failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, BSIZE) != -1){
+    printf("%s: fallocate on a read-only fd succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 50; i++){
+    if(read(fd, blk, 100) != 100 || blk[0] != 'a' + i % 26 || blk[99] != 'a' + i % 26){
+      printf("%s: wrong data\n", s);
+      exit(1);
+    }
+  }
+  if(read(fd, blk, 1) != 0){
+    printf("%s: file too long\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("falloc");
+
+  if((fd = open("falloc", O_CREATE | O_RDWR)) < 0 || fsetmap(fd, FM_BLOCKS) < 0){
+    printf("%s: create falloc failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fd, 0, BSIZE) != -1){
+    printf("%s: fallocate of a block-mapped file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("falloc");
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fallocate(fds[1], 0, BSIZE) != -1){
+    printf("%s: fallocate on a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// a file whose blocks are all apart needs an extent per block,
+// more than a tree of two levels holds (3 index entries of 85
+// extents).  fraga and fragb reserve blocks in turn, so that
+// neither's are next to each other; fragfill reserves all the
+// rest of the disk; and unlinking fragb leaves only single free
+// blocks for fragc to be written into.
+#define NFRAG 400
+
+void
+fragfile(char *s)
+{
+  char *names[] = { "fraga", "fragb", "fragc", "fragfill" };
+  int fd[4], i, j;
+
+  for(i = 0; i < 4; i++){
+    unlink(names[i]);
+    if((fd[i] = open(names[i], O_CREATE | O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, names[i]);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NFRAG + 50; i++){
+    for(j = 0; j < 2; j++){
+      if(fallocate(fd[j], i*BSIZE, BSIZE) != 0){
+        printf("%s: fallocate of %s block %d failed\n", s, names[j], i);
+        exit(1);
+      }
+    }
+  }
+  // A reservation is all or nothing, so fill the disk in
+  // steps, ending with single blocks.
+  for(i = 0; fallocate(fd[3], i*BSIZE, 64*BSIZE) == 0; i += 64)
+    ;
+  for(; fallocate(fd[3], i*BSIZE, BSIZE) == 0; i++)
+    ;
+  close(fd[1]);
+  unlink("fragb");
+
+  for(i = 0; i < NFRAG; i++){
+    memset(buf, 'a' + i % 26, BSIZE);
+    ((int*)buf)[0] = i;
+    if(write(fd[2], buf, BSIZE) != BSIZE){
+      printf("%s: write of fragc block %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd[2]);
+  if((fd[2] = open("fragc", O_RDONLY)) < 0){
+    printf("%s: open fragc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NFRAG; i++){
+    if(read(fd[2], buf, BSIZE) != BSIZE || ((int*)buf)[0] != i ||
+       buf[BSIZE-1] != 'a' + i % 26){
+      printf("%s: wrong data in fragc block %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(read(fd[2], buf, 1) != 0){
+    printf("%s: fragc too long\n", s);
+    exit(1);
+  }
+  close(fd[0]);
+  close(fd[2]);
+  close(fd[3]);
+  unlink("fraga");
+  unlink("fragc");
+  unlink("fragfill");
+}
+
+// the disk still works with polled completion, both when
+// polls give up at once and when they find the requests.
+void
+diskpolltest(char *s)
+{
+  char blk[BSIZE], name[3];
+  int fd, i, j, k, pid, xstatus, spins[2] = { 1, 100000 };
+
+  if(diskpoll(-1) != -1){
+    printf("%s: diskpoll(-1) succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    diskpoll(spins[i]);
+    name[0] = 'p';
+    name[2] = 0;
+    for(j = 0; j < 2; j++){
+      name[1] = '0' + j;
+      if((pid = fork()) < 0){
+        printf("%s: fork failed\n", s);
+        exit(1);
+      }
+      if(pid == 0){
+        if((fd = open(name, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+          exit(1);
+        memset(blk, 'a' + j, sizeof(blk));
+        for(k = 0; k < 20; k++){
+          if(write(fd, blk, BSIZE) != BSIZE || fsync(fd) != 0)
+            exit(1);
+        }
+        exit(0);
+      }
+    }
+    for(j = 0; j < 2; j++){
+      wait(&xstatus);
+      if(xstatus != 0){
+        diskpoll(0);
+        printf("%s: write with polling failed\n", s);
+        exit(1);
+      }
+    }
+    for(j = 0; j < 2; j++){
+      name[1] = '0' + j;
+      if((fd = open(name, O_RDONLY)) < 0){
+        diskpoll(0);
+        printf("%s: open %s failed\n", s, name);
+        exit(1);
+      }
+      while((xstatus = read(fd, blk, BSIZE)) == BSIZE && blk[0] == 'a' + j && blk[BSIZE-1] == 'a' + j)
+        ;
+      close(fd);
+      unlink(name);
+      if(xstatus != 0){
+        diskpoll(0);
+        printf("%s: wrong data in %s\n", s, name);
+        exit(1);
+      }
+    }
+  }
+  if(diskpoll(0) != spins[1]){
+    printf("%s: diskpoll returned the wrong setting\n", s);
+    exit(1);
+  }
+}
+
+// mount() refuses devices that are not there, and the root
+// device.  mounttest covers the refusals that need a real disk.
+void
+mountbad(char *s)
+{
+  if(mkdir("mntdir") != 0){
+    printf("%s: mkdir mntdir failed\n", s);
+    exit(1);
+  }
+  if(mount(-1, "mntdir") == 0 || mount(99, "mntdir") == 0){
+    printf("%s: mount of a bad device succeeded\n", s);
+    exit(1);
+  }
+  if(mount(ROOTDEV, "mntdir") == 0){
+    printf("%s: mount of the root device succeeded\n", s);
+    exit(1);
+  }
+  if(unlink("mntdir") != 0){
+    printf("%s: unlink mntdir failed\n", s);
+    exit(1);
+  }
+}
+
+// Is there a disk driver for dev?  The fsstats device has a
+// "disk: dev N ..." line for each one.
+int
+diskattached(char *s, int dev)
+{
+  static char st[4096];
+  char *p;
+  int n;
+
+  if((n = fsstatistics(st, sizeof(st)-1)) <= 0){
+    printf("%s: fsstatistics failed\n", s);
+    exit(1);
+  }
+  st[n] = 0;
+  for(p = st; *p; p++){
+    if(memcmp(p, "disk: dev ", 10) == 0 && atoi(p + 10) == dev)
+      return 1;
+  }
+  return 0;
+}
+
+// Mount fs1.img on /umnt and use it: a file made there lives on
+// that disk, ".." at its root leads back to the root file system,
+// and the mount point can be neither removed nor mounted on again.
+// Needs both extra disks (make qemu DISKS=2).  There is no
+// unmount, so a second run finds /umnt already mounted and goes
+// straight to the checks.
+void
+mounttest(char *s)
+{
+  struct stat st;
+  int fd, i;
+
+  if(!diskattached(s, ROOTDEV+1) || !diskattached(s, ROOTDEV+2)){
+    printf("skipped, needs make qemu DISKS=2: ");
+    return;
+  }
+
+  mkdir("/umnt");
+  if(stat("/umnt", &st) < 0){
+    printf("%s: mkdir /umnt failed\n", s);
+    exit(1);
+  }
+  if(st.dev != ROOTDEV+1){
+    if((fd = open("mntfile", O_CREATE | O_RDWR)) < 0){
+      printf("%s: create mntfile failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(mount(ROOTDEV+2, "mntfile") == 0 || mount(ROOTDEV+2, "mntnone") == 0){
+      printf("%s: mount on a non-directory succeeded\n", s);
+      exit(1);
+    }
+    unlink("mntfile");
+    if(mount(ROOTDEV+1, "/umnt") != 0){
+      printf("%s: mount of fs1.img failed\n", s);
+      exit(1);
+    }
+  }
+  if(stat("/umnt", &st) < 0 || st.dev != ROOTDEV+1 || st.ino != ROOTINO){
+    printf("%s: /umnt is not the root of fs1.img\n", s);
+    exit(1);
+  }
+  if(stat("/umnt/..", &st) < 0 || st.dev != ROOTDEV || st.ino != ROOTINO){
+    printf("%s: /umnt/.. is not the root directory\n", s);
+    exit(1);
+  }
+
+  if((fd = open("/umnt/mf", O_CREATE | O_TRUNC | O_RDWR)) < 0){
+    printf("%s: create /umnt/mf failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < BSIZE*3; i++)
+    buf[i] = 'a' + i % 23;
+  if(write(fd, buf, BSIZE*3) != BSIZE*3){
+    printf("%s: write /umnt/mf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(stat("/umnt/mf", &st) < 0 || st.dev != ROOTDEV+1 || st.size != BSIZE*3){
+    printf("%s: /umnt/mf is not on fs1.img\n", s);
+    exit(1);
+  }
+  memset(buf, 0, BSIZE*3);
+  if((fd = open("/umnt/mf", O_RDONLY)) < 0 || read(fd, buf, BSIZE*3) != BSIZE*3){
+    printf("%s: read /umnt/mf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < BSIZE*3; i++){
+    if(buf[i] != 'a' + i % 23){
+      printf("%s: /umnt/mf has the wrong content\n", s);
+      exit(1);
+    }
+  }
+
+  if(unlink("/umnt") == 0){
+    printf("%s: unlink of a mount point succeeded\n", s);
+    exit(1);
+  }
+  if(mount(ROOTDEV+2, "/umnt") == 0){
+    printf("%s: mount on a mount point succeeded\n", s);
+    exit(1);
+  }
+  if(mkdir("mntdir") != 0){
+    printf("%s: mkdir mntdir failed\n", s);
+    exit(1);
+  }
+  if(mount(ROOTDEV+1, "mntdir") == 0){
+    printf("%s: second mount of fs1.img succeeded\n", s);
+    exit(1);
+  }
+  unlink("mntdir");
+  if(link("/umnt/mf", "mflink") == 0){
+    printf("%s: link across devices succeeded\n", s);
+    exit(1);
+  }
+  if(unlink("/umnt/mf") != 0){
+    printf("%s: unlink /umnt/mf failed\n", s);
+    exit(1);
+  }
+}
+
+// getdents() returns every entry of a directory once,
+// across calls, with the right stat if asked.
+void
+getdentstest(char *s)
+{
+  enum { N = 10 };
+  struct dirstat ds[3];
+  struct stat st;
+  char name[8], seen[N];
+  int fd, i, n, k, ndot;
+
+  if(mkdir("gdd") != 0){
+    printf("%s: mkdir gdd failed\n", s);
+    exit(1);
+  }
+  name[0] = 'g';
+  name[1] = 'd';
+  name[2] = 'd';
+  name[3] = '/';
+  name[5] = 0;
+  for(i = 0; i < N; i++){
+    name[4] = 'a' + i;
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    write(fd, name, i);
+    close(fd);
+  }
+
+  if((fd = open("gdd", O_RDONLY)) < 0){
+    printf("%s: open gdd failed\n", s);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  ndot = 0;
+  while((n = getdents(fd, ds, 3, GD_STAT)) > 0){
+    for(k = 0; k < n; k++){
+      if(strcmp(ds[k].name, ".") == 0 || strcmp(ds[k].name, "..") == 0){
+        ndot++;
+        continue;
+      }
+      i = ds[k].name[0] - 'a';
+      if(ds[k].name[1] != 0 || i < 0 || i >= N || seen[i]){
+        printf("%s: getdents returned %s\n", s, ds[k].name);
+        exit(1);
+      }
+      seen[i] = 1;
+      name[4] = 'a' + i;
+      if(stat(name, &st) < 0 || st.ino != ds[k].ino ||
+         ds[k].st.ino != ds[k].ino || ds[k].st.type != T_FILE || ds[k].st.size != i){
+        printf("%s: getdents wrong stat for %s\n", s, name);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  if(n < 0 || ndot != 2){
+    printf("%s: getdents failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(!seen[i]){
+      printf("%s: getdents missed %c\n", s, 'a' + i);
+      exit(1);
+    }
+    name[4] = 'a' + i;
+    unlink(name);
+  }
+  unlink("gdd");
+}
+
 void
 subdir(char *s)
 {
@@ -2691,9 +3615,22 @@ main(int argc, char *argv[])
     {fourteen, "fourteen"},
     {bigfile, "bigfile"},
     {dirfile, "dirfile"},
+    {getdentstest, "getdents"},
+    {preadwrite, "preadwrite"},
+    {sendfiletest, "sendfile"},
+    {setmap, "setmap"},
+    {delalloc, "delalloc"},
+    {delaysweep, "delaysweep"},
+    {freereuse, "freereuse"},
+    {fallocatetest, "fallocate"},
+    {fragfile, "fragfile"},
+    {diskpolltest, "diskpoll"},
+    {mountbad, "mountbad"},
+    {mounttest, "mounttest"},
     {iref, "iref"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
+    {bigindex, "bigindex"}, // slow
     { 0, 0},
   };
 
@@ -36,3 +36,14 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("getdents");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("sendfile");
+entry("fsync");
+entry("fallocate");
+entry("diskpoll");
+entry("mount");
+entry("fsetmap");
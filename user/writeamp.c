@@ -0,0 +1,163 @@
+//
+// Measure how many bytes the file system writes to disk for
+// each byte a program writes.
+//
+//   writeamp [test]
+//
+// Each test writes a file and closes it, then reports the
+// disk blocks written meanwhile, as counted by the fsstats
+// device, and how many of them went to the log or were file
+// data written home.  Checkpoints are lazy, so a test pays
+// for the installation of earlier tests' log blocks, and not
+// for all of its own.  With no test, runs them all.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NBLOCK 256
+
+char stats[4096];
+char buf[16*BSIZE];
+
+// Return a pointer just past the first key at or after p.
+char*
+skip(char *p, char *key)
+{
+  int k;
+
+  k = strlen(key);
+  for(; *p; p++){
+    if(memcmp(p, key, k) == 0)
+      return p+k;
+  }
+  fprintf(2, "writeamp: no %s in stats\n", key);
+  exit(1);
+}
+
+#define NSTAT 3
+
+// Read the disk writes, log blocks and data blocks written
+// home from the fsstats device.
+void
+fsstats(int *v)
+{
+  char *p;
+  int n;
+
+  n = fsstatistics(stats, sizeof(stats)-16);
+  if(n <= 0){
+    fprintf(2, "writeamp: no stats\n");
+    exit(1);
+  }
+  memset(stats+n, 0, 16);
+  p = skip(stats, "bcache: disk reads ");
+  p = skip(p, " writes ");
+  v[0] = atoi(p);
+  p = skip(stats, "log: commits ");
+  p = skip(p, " blocks ");
+  v[1] = atoi(p);
+  p = skip(p, " data ");
+  v[2] = atoi(p);
+}
+
+void
+fail(char *what)
+{
+  printf("writeamp: %s failed\n", what);
+  exit(1);
+}
+
+// Write NBLOCK blocks, 16 at a time.
+void
+big(int fd)
+{
+  int i;
+
+  for(i = 0; i < NBLOCK; i += 16){
+    if(write(fd, buf, 16*BSIZE) != 16*BSIZE)
+      fail("write");
+  }
+}
+
+// Write NBLOCK blocks, a sixteenth of a block at a time.
+void
+small(int fd)
+{
+  int i;
+
+  for(i = 0; i < 16*NBLOCK; i++){
+    if(write(fd, buf, BSIZE/16) != BSIZE/16)
+      fail("write");
+  }
+}
+
+// Write NBLOCK/4 blocks, one at a time, each followed by
+// fsync().
+void
+sync(int fd)
+{
+  int i;
+
+  for(i = 0; i < NBLOCK/4; i++){
+    if(write(fd, buf, BSIZE) != BSIZE)
+      fail("write");
+    if(fsync(fd) != 0)
+      fail("fsync");
+  }
+}
+
+struct test {
+  void (*f)(int);
+  char *s;
+  int nbyte;    // bytes f writes
+} tests[] = {
+  {big, "big", NBLOCK*BSIZE},
+  {small, "small", NBLOCK*BSIZE},
+  {sync, "fsync", NBLOCK/4*BSIZE},
+  { 0, 0, 0},
+};
+
+void
+run(struct test *t)
+{
+  int fd, v0[NSTAT], v[NSTAT], r;
+
+  unlink("writeamp.tmp");
+  fsstats(v0);
+  if((fd = open("writeamp.tmp", O_CREATE | O_WRONLY)) < 0)
+    fail("create");
+  t->f(fd);
+  close(fd);
+  fsstats(v);
+  unlink("writeamp.tmp");
+
+  // disk bytes per user byte, in hundredths.
+  r = (v[0] - v0[0]) * BSIZE * 100 / t->nbyte;
+  printf("%s: %d bytes, %d blocks written (%d logged, %d data), %d.%d%d bytes/byte\n",
+         t->s, t->nbyte, v[0] - v0[0], v[1] - v0[1], v[2] - v0[2],
+         r / 100, r / 10 % 10, r % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct test *t;
+  int found = 0;
+
+  memset(buf, 'w', sizeof(buf));
+  for(t = tests; t->s != 0; t++){
+    if(argc < 2 || strcmp(argv[1], t->s) == 0){
+      run(t);
+      found = 1;
+    }
+  }
+  if(!found){
+    fprintf(2, "writeamp: no test %s\n", argv[1]);
+    exit(1);
+  }
+  exit(0);
+}